@@ -5,8 +5,23 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <stb/stb_image.h>
 #include "shader.h"
+#include "shader_compiler.h"
+#include "shader_reloader.h"
+#include "shader_variants.h"
+#include "camera_block.h"
+#include "embedded_shaders.h"
+#include "gl_state.h"
+#include "spirv_loader.h"
+#include "texture_loader.h"
+#include "texture_manager.h"
+#include "texture_packer.h"
+#include "material_table.h"
+#include "virtual_texture.h"
+#include "virtual_file_system.h"
+#include "mesh_builder.h"
 
 #include <iostream>
+#include <filesystem>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -21,6 +36,10 @@ glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);  // Upwards pointing vector
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// How much of texture2 is mixed in, changed with the up/down arrows
+float mixAmount = 0.2f;
+bool mixChanged = false;
+
 
 int main() {
 	glfwInit();
@@ -49,71 +68,120 @@ int main() {
 		return -1;
 	}
 
+	// ---- ASSET PACK ---- //
+	// Every asset packed by Tools/AssetPacker in one mapped file, the loose files are the fallback
+	VirtualFileSystem assets;
+	if (std::filesystem::exists("assets.pak") && assets.mount("assets.pak"))
+		std::cout << "Asset pack: " << assets.fileCount() << " files, " << assets.blobCount() << " stored" << std::endl;
+
 	// ---- SHADER PROGRAM ---- //
-	Shader shaderProgram("shader.vs", "shader.fs");
+	// The shaders are compiled into the executable (Tools/ShaderEmbed)
+	ShaderPreprocessor::useEmbedded(EmbeddedShaders::all);
+	ShaderPreprocessor::packFiles = &assets;
+#ifdef _DEBUG
+	// Debug builds prefer the files on disk, so edits show up with the hot-reload
+	ShaderPreprocessor::diskOverride = true;
+#endif
+
+	// Draws find their textures in this table, through bindless handles when the driver has them,
+	// the shaders are built for one or the other with its defines
+	MaterialTable materialTable((GLADloadproc)glfwGetProcAddress);
+
+	// Shaders precompiled to SPIR-V by Tools/ShaderSpirv skip the driver's GLSL compiler,
+	// if they aren't there (or while editing the GLSL) the embedded sources are used.
+	// They're built without bindless, which needs the GLSL path
+	unsigned int spirvProgram = 0;
+	if (!ShaderPreprocessor::diskOverride && SpirvLoader::supported() && !materialTable.bindless)
+		spirvProgram = SpirvLoader::loadProgram("spirv/shader.vs.spv", "spirv/shader.fs.spv");
+
+	// Variants of the cube's shader: the mix amount fixed at compile time (MIX_AMOUNT),
+	// or read from a uniform (USE_MIX_UNIFORM) once the arrows change it.
+	// Every variant gets the material table's defines (BINDLESS)
+	ShaderVariants cubeShaders(EmbeddedShaders::shader_vs, EmbeddedShaders::shader_fs, materialTable.defines());
+	const ShaderDefines fixedMix = { { "MIX_AMOUNT", "0.2" } };
+	const ShaderDefines uniformMix = { { "USE_MIX_UNIFORM", "" } };
+	const uint64_t uniformMixKey = ShaderVariants::variantKey(uniformMix);
+
+	// Only queue the compiles here, the driver works on them while the textures load
+	ShaderCompiler shaderCompiler((GLADloadproc)glfwGetProcAddress);
+	ShaderCompiler::ProgramFuture shaderFuture;
+	if (spirvProgram == 0)
+		shaderFuture = cubeShaders.submit(shaderCompiler, fixedMix);
+	// There's no SPIR-V of the uniform variant, it's compiled from GLSL either way
+	// (with SPIR-V there's no bindless, so it reads the table the same way)
+	cubeShaders.submit(shaderCompiler, uniformMix);
 
 	// ---- LOAD AND CREATE TEXTURE ---- //
-	// Create texture objects
-	unsigned int texture1, texture2;
-	glGenTextures(1, &texture1);
-	glGenTextures(1, &texture2);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture1);
-
-	// Texture wrapping and filtering
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// Load the first image.
-	int width, height, nrChannels;
-
-	// Flip image.
-	stbi_set_flip_vertically_on_load(true);
-
-	unsigned char* data = stbi_load("./container.jpg", &width, &height, &nrChannels, 0);
-
-	if (data) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+	// The images are decoded on worker threads and uploaded a few at a time,
+	// until then the handles give a 1x1 placeholder texture
+	TextureLoader textureLoader;
+	textureLoader.files = &assets;
+	// Shares textures by content and keeps them within 256 MB of GPU memory
+	TextureManager textureManager(textureLoader, 256 * 1024 * 1024);
+	// Textures cooked by Tools/TextureCooker (mips included) skip the decoding, the images are the fallback
+	auto cookedOr = [&assets](const std::string& cooked, const std::string& image) {
+		return assets.exists(cooked) || std::filesystem::exists(cooked) ? cooked : image;
+	};
+	TextureRef texture1 = textureManager.acquire(cookedOr("cooked/container.ktx2", "./container.jpg"));
+	TextureRef texture2 = textureManager.acquire(cookedOr("cooked/awesomeface.ktx2", "./awesomeface.png"));
+
+	// Now the program is needed, wait for it if it isn't done yet
+	Shader spirvShader(spirvProgram);
+	Shader& shaderProgram = spirvProgram != 0 ? spirvShader : cubeShaders.get(fixedMix);
+	if (spirvProgram != 0) {
+		shaderProgram.addUniformLocations(SpirvLoader::readUniforms("spirv/shader.vs.uniforms"));
+		shaderProgram.addUniformLocations(SpirvLoader::readUniforms("spirv/shader.fs.uniforms"));
 	}
 	else {
-		std::cout << "Failed to load texture" << std::endl;
+		std::cout << "Shader program ready in " << shaderFuture.buildMilliseconds() << " ms ("
+			<< (shaderFuture.fromBinaryCache() ? "warm, binary cache" : "cold, compiled from source") << ")" << std::endl;
 	}
 
-
-	// Good practice to free image from memory
-	stbi_image_free(data);
-
-	// Now activate, bind and configure second texture
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, texture2);
-
-	// Texture wrapping and filtering
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// Load the second image.
-	data = stbi_load("./awesomeface.png", &width, &height, &nrChannels, 0);
-
-	if (data) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else {
-		std::cout << "Failed to load texture" << std::endl;
+	// ---- PACK TEXTURES ---- //
+	// Packing needs the size and format of every texture, so the few loaded at startup
+	// are finished here (their decoding ran while the shaders compiled)
+	textureLoader.finishAll();
+	TexturePacker texturePacker;
+	int slot1 = texturePacker.add(textureManager.id(texture1), textureManager.info(texture1));
+	int slot2 = texturePacker.add(textureManager.id(texture2), textureManager.info(texture2));
+	texturePacker.pack();
+	const TextureSlot& textureSlot1 = texturePacker.slot(slot1);
+	const TextureSlot& textureSlot2 = texturePacker.slot(slot2);
+	// Only the arrays are drawn with now, the manager frees the 2D textures when it needs the room
+	texture1 = TextureRef();
+	texture2 = TextureRef();
+	// Every cube uses the same material, the shader reads its textures from the table
+	unsigned int containerMaterial = materialTable.add(textureSlot1, textureSlot2);
+
+	// ---- VIRTUAL TEXTURE ---- //
+	// With a tile file cooked by Tools/TextureCooker --virtual, the container texture is
+	// streamed in tiles as the cubes need them, instead of being loaded whole
+	VirtualTexture virtualTexture;
+	ShaderVariants virtualShaders(EmbeddedShaders::shader_vs, EmbeddedShaders::virtual_fs, materialTable.defines());
+	Shader* virtualProgram = nullptr;
+	Shader feedbackProgram(0);
+	if (std::filesystem::exists("cooked/container.vtex") && virtualTexture.open("cooked/container.vtex")) {
+		virtualShaders.submit(shaderCompiler, uniformMix);
+		virtualProgram = &virtualShaders.get(fixedMix);
+		feedbackProgram.replaceProgram(shaderCompiler.submit(EmbeddedShaders::shader_vs, EmbeddedShaders::virtual_feedback_fs).get());
+		if (virtualProgram->ID == 0 || feedbackProgram.ID == 0)
+			virtualTexture.destroy();
 	}
 
-	stbi_image_free(data);
-
-	// Tell OpenGL to which texture unit each shader sampler2D belongs to
-	shaderProgram.use();
-	shaderProgram.setInt("texture1", 0);
-	shaderProgram.setInt("texture2", 1);
+	// Rebuild every program the cubes are drawn with in the background whenever its files
+	// are saved, only when reading from disk, the embedded sources can't change.
+	// The reloader creates its context and thread on the first watch(), so without
+	// diskOverride it costs nothing. The uniform variants are watched once they compile
+	ShaderReloader shaderReloader(window);
+	if (ShaderPreprocessor::diskOverride) {
+		auto watchVariant = [&shaderReloader](Shader& variant, const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines) {
+			shaderReloader.watch(variant, vertexPath, fragmentPath, nullptr, defines);
+		};
+		cubeShaders.onCompiled(watchVariant);
+		virtualShaders.onCompiled(watchVariant);
+		if (virtualTexture.valid())
+			shaderReloader.watch(feedbackProgram, "shader.vs", "virtual_feedback.fs");
+	}
 
 
 	// ---- CUBE VERTICES ---- //
@@ -165,16 +233,33 @@ int main() {
 	};
 
 
-	// VAO, VBO
+	// The 36 vertices repeat the corners each triangle shares, welded they're only
+	// stored (and run through the vertex shader) once, the triangles use indices.
+	// build() also reorders them for the vertex cache, overdraw and vertex fetch
+	MeshBuilder cubeBuilder(5);
+	cubeBuilder.addTriangles(vertices, 36);
+	IndexedMesh cube = cubeBuilder.build();
+	GLenum cubeIndexType = cube.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	std::cout << "Cube: " << cubeBuilder.inputVertexCount() << " vertices welded into " << cube.vertexCount() << ", "
+		<< cube.indexCount() << " " << cube.indexSize * 8 << " bit indices" << std::endl;
+	std::cout << "Cube vertex cache: ACMR " << cubeBuilder.report.before.acmr << " -> " << cubeBuilder.report.after.acmr
+		<< ", ATVR " << cubeBuilder.report.before.atvr << " -> " << cubeBuilder.report.after.atvr << std::endl;
+
+
+	// VAO, VBO, EBO
 	unsigned int VAO, VBO, EBO;
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 	glGenBuffers(1, &EBO);
 
-	glBindVertexArray(VAO);
+	GLState::bindVertexArray(VAO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, cube.vertexBytes(), cube.vertices.data(), GL_STATIC_DRAW);
+
+	// The element buffer binding is part of the VAO
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, cube.indexBytes(), cube.indexData(), GL_STATIC_DRAW);
 
 	// Position attribute
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
@@ -192,8 +277,13 @@ int main() {
 	glm::mat4 projection;			// fov, aspect ratio, near plane, far plane
 	projection = glm::perspective(glm::radians(45.f), 800.0f / 600.0f, 0.1f, 100.0f);
 
+	// view and projection go into a uniform buffer shared by every program
+	CameraBlock cameraBlock;
+	// The projection doesn't change, so after the first frame it's never uploaded again
+	cameraBlock.setProjection(projection);
+
 	// Enable depth test (z-buffer or depth buffer)
-	glEnable(GL_DEPTH_TEST);
+	GLState::setDepthTest(true);
 
 	// Cube positions for drawing multiple cubes
 
@@ -271,10 +361,32 @@ int main() {
 
 	// ----- CAMERA ----- //
 
+	// Uniform names hashed at compile time, used by the setters in the render loop
+	constexpr UniformHandle modelUniform("model");
+	constexpr UniformHandle materialIdUniform("materialId");
+	constexpr UniformHandle mixAmountUniform("mixAmount");
+
+	// Draw each cube by modyfing the model matrix
+	auto drawCubes = [&](Shader& program) {
+		for (unsigned int i = 0; i < 10; i++) {
+			glm::mat4 model = glm::mat4(1.0f);
+			model = glm::translate(model, cubePositions[i]);
+			float angle = 20.0f * i;
+			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+			// Send matrix data to the respective uniform
+			program.setMat4(modelUniform, GL_FALSE, model);
+			// Selecting the textures of this draw, the same with or without bindless
+			program.setInt(materialIdUniform, containerMaterial);
+
+			glDrawElements(GL_TRIANGLES, (GLsizei)cube.indexCount(), cubeIndexType, (void*)0);
+		}
+	};
+
 	// App main loop
 	while (!glfwWindowShouldClose(window))
 	{	
 		// Per-frame logic
+		GLState::beginFrame();
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
@@ -283,23 +395,19 @@ int main() {
 		// input
 		processInput(window);
 
+		// Use any program that finished reloading since the last frame
+		shaderReloader.swapReady();
+		// Upload decoded textures, spending at most 2 ms of the frame on it
+		textureLoader.uploadPending(2.0);
+
 		// render
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // also clears GL_DEPTH_BUFFER_BIT before each render iteration
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture1);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, texture2);
-
-		// Get location of needed matrix uniforms
-		int projectionLoc = glGetUniformLocation(shaderProgram.ID, "projection");
-
-		// Send matrices data to the respective uniforms
-		glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-		shaderProgram.use();
-		glBindVertexArray(VAO);
+		// The material table, and without bindless the texture arrays it points to,
+		// bound once: no draw below binds a texture
+		materialTable.bind();
+		GLState::bindVertexArray(VAO);
 
 		// ----- CAMERA POSITION ----- //
 
@@ -310,38 +418,69 @@ int main() {
 		*/
 					// camera pos       // camera target      // vector pointing upwards from the camera
 		view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-		shaderProgram.setMat4("view", GL_FALSE, view);
+		cameraBlock.setView(view);
+		cameraBlock.update();
 
 		// ----- CAMERA POSITION ----- //
 
-		// Draw each cube by modyfing the model matrix
-		for (unsigned int i = 0; i < 10; i++) {
-			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::translate(model, cubePositions[i]);
-			float angle = 20.0f * i;
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-			// Send matrix data to the respective uniform
-			shaderProgram.setMat4("model", GL_FALSE, model);
-
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+		if (virtualTexture.valid()) {
+			// Feedback pass: which tiles of the virtual texture the cubes need
+			virtualTexture.beginFeedback(feedbackProgram);
+			drawCubes(feedbackProgram);
+			virtualTexture.endFeedback();
+			// Requests what the feedback of a frame or two ago asked for, uploads what's arrived
+			virtualTexture.update();
 		}
 
+		// The fixed mix variant until the arrows are used, then the uniform one as soon as it's compiled
+		ShaderVariants& variants = virtualTexture.valid() ? virtualShaders : cubeShaders;
+		Shader* mixProgram = mixChanged ? variants.find(uniformMixKey) : nullptr;
+		Shader& program = mixProgram != nullptr ? *mixProgram : virtualTexture.valid() ? *virtualProgram : shaderProgram;
+		program.use();
+		if (virtualTexture.valid())
+			virtualTexture.bind(program);
+		if (&program == mixProgram)
+			program.setFloat(mixAmountUniform, mixAmount);
+		drawCubes(program);
+
+		// Textures over the memory budget are freed or shrunk
+		textureManager.endFrame();
+
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
 	// de-allocate all resources
-	glDeleteVertexArrays(1, &VAO);
+	GLState::deleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
-
+	glDeleteBuffers(1, &cameraBlock.UBO);
+	virtualTexture.destroy();
+	materialTable.destroy();
+	texturePacker.deleteTextures();
+	textureLoader.deleteTextures();
+
+	std::cout << "Uniform calls saved by the camera block: " << cameraBlock.uniformCallsSaved << std::endl;
+	std::cout << "GL state calls in the last frame: " << GLState::lastFrame.issued << " issued, "
+		<< GLState::lastFrame.elided << " elided" << std::endl;
+	std::cout << "Textures: " << textureManager.textureCount() << " (" << textureManager.residentBytes / 1024 << " KB), "
+		<< textureManager.stats.sharedLoads << " shared loads, " << textureManager.stats.evictions << " evicted, "
+		<< textureManager.stats.mipsDropped << " mips dropped" << std::endl;
+	std::cout << "Texture arrays: " << texturePacker.stats.arrays << " (" << texturePacker.stats.layers << " layers, "
+		<< texturePacker.stats.atlasLayers << " atlas layers " << (int)(texturePacker.stats.atlasOccupancy * 100) << "% full)" << std::endl;
+	if (virtualTexture.stats.uploads > 0)
+		std::cout << "Virtual texture: " << virtualTexture.residentCount() << " tiles resident, " << virtualTexture.stats.requests
+			<< " requested, " << virtualTexture.stats.uploads << " uploaded, " << virtualTexture.stats.evictions << " evicted" << std::endl;
+	std::cout << "Materials: " << materialTable.count() << (materialTable.bindless ? " (bindless)" : " (texture array fallback)") << std::endl;
+
+	shaderReloader.stop();
 	glfwTerminate();
 	return 0;
 }
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-	glViewport(0, 0, width, height);
+	GLState::viewport(0, 0, width, height);
 }
 
 
@@ -359,4 +498,13 @@ void processInput(GLFWwindow* window) {
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 		cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
 
+	if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+		mixAmount = glm::min(mixAmount + deltaTime, 1.0f);
+		mixChanged = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+		mixAmount = glm::max(mixAmount - deltaTime, 0.0f);
+		mixChanged = true;
+	}
+
 }
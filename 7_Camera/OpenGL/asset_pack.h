@@ -0,0 +1,160 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+/*
+	Pack file (.pak) holding every asset of the lessons (images, shaders,
+	cooked textures...), written by Tools/AssetPacker and read through a
+	VirtualFileSystem. No OpenGL here so the tools can use it.
+
+	Layout:
+		header (48 bytes)
+		index: one Entry per file, sorted by the hash of its path, so a
+		lookup is a binary search
+		names: the paths of the entries, one after another
+		data: the contents, each one 16 byte aligned
+
+	The data is content addressed: files with the same bytes (like the
+	container.jpg copied into every lesson) are stored once, and their
+	entries point to the same place.
+*/
+namespace AssetPack {
+
+	const char magic[4] = { 'A', 'P', 'A', 'K' };
+	const uint32_t version = 1;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t blobCount;
+		uint64_t indexOffset;
+		uint64_t namesOffset;
+		uint64_t dataOffset;
+		uint64_t reserved;
+	};
+	static_assert(sizeof(Header) == 48, "Pack header must be 48 bytes");
+
+	struct Entry {
+		uint64_t pathHash;
+		// FNV-1a of the contents, the same as ProgramCache::contentHash
+		uint64_t contentHash;
+		uint64_t offset;
+		uint64_t size;
+		uint32_t nameOffset;
+		uint32_t nameLength;
+	};
+	static_assert(sizeof(Entry) == 40, "Pack entries must be 40 bytes");
+
+	// 64 bit FNV-1a
+	inline uint64_t hash(const void* data, size_t length) {
+		uint64_t result = 14695981039346656037ull;
+		for (size_t i = 0; i < length; i++) {
+			result ^= ((const uint8_t*)data)[i];
+			result *= 1099511628211ull;
+		}
+		return result;
+	}
+
+	// Paths are stored as "textures/wall.jpg": forward slashes, no "./" or ".."
+	inline std::string normalize(const std::string& path) {
+		std::string name = std::filesystem::path(path).lexically_normal().generic_string();
+		while (name.compare(0, 2, "./") == 0)
+			name.erase(0, 2);
+		return name;
+	}
+
+	struct File {
+		std::string name;
+		std::vector<uint8_t> contents;
+	};
+
+	/*
+		Writes the pack. Names are normalized, two files with the same
+		name are an error. Returns the number of different contents stored
+		through blobCount, or false if the file can't be written.
+	*/
+	inline bool write(const std::string& path, const std::vector<File>& files, uint32_t* blobCount = nullptr) {
+		std::vector<Entry> entries;
+		std::string names;
+		std::vector<const File*> blobs;
+		// Content hash -> blobs with it, compared byte by byte in case two contents share a hash
+		std::unordered_map<uint64_t, std::vector<size_t>> blobsByHash;
+		std::vector<size_t> blobOfEntry;
+
+		for (const File& file : files) {
+			std::string name = normalize(file.name);
+			Entry entry = {};
+			entry.pathHash = hash(name.data(), name.size());
+			entry.contentHash = hash(file.contents.data(), file.contents.size());
+			entry.size = file.contents.size();
+			entry.nameOffset = (uint32_t)names.size();
+			entry.nameLength = (uint32_t)name.size();
+			names += name;
+
+			size_t blob = blobs.size();
+			for (size_t candidate : blobsByHash[entry.contentHash]) {
+				if (blobs[candidate]->contents == file.contents)
+					blob = candidate;
+			}
+			if (blob == blobs.size()) {
+				blobsByHash[entry.contentHash].push_back(blob);
+				blobs.push_back(&file);
+			}
+			entries.push_back(entry);
+			blobOfEntry.push_back(blob);
+		}
+
+		Header header = {};
+		std::memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.entryCount = (uint32_t)entries.size();
+		header.blobCount = (uint32_t)blobs.size();
+		header.indexOffset = sizeof(Header);
+		header.namesOffset = header.indexOffset + sizeof(Entry) * entries.size();
+		header.dataOffset = (header.namesOffset + names.size() + 15) & ~(uint64_t)15;
+
+		std::vector<uint64_t> blobOffsets;
+		uint64_t offset = header.dataOffset;
+		for (const File* blob : blobs) {
+			blobOffsets.push_back(offset);
+			offset = (offset + blob->contents.size() + 15) & ~(uint64_t)15;
+		}
+		for (size_t i = 0; i < entries.size(); i++)
+			entries[i].offset = blobOffsets[blobOfEntry[i]];
+
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.pathHash < b.pathHash; });
+		for (size_t i = 1; i < entries.size(); i++) {
+			if (entries[i].pathHash == entries[i - 1].pathHash)
+				return false;
+		}
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)entries.data(), sizeof(Entry) * entries.size());
+		file.write(names.data(), names.size());
+
+		uint64_t written = header.namesOffset + names.size();
+		const char padding[16] = {};
+		for (size_t i = 0; i < blobs.size(); i++) {
+			file.write(padding, blobOffsets[i] - written);
+			file.write((const char*)blobs[i]->contents.data(), blobs[i]->contents.size());
+			written = blobOffsets[i] + blobs[i]->contents.size();
+		}
+		if (blobCount != nullptr)
+			*blobCount = header.blobCount;
+		return (bool)file;
+	}
+}
+
+#endif
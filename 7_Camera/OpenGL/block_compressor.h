@@ -0,0 +1,695 @@
+#ifndef BLOCK_COMPRESSOR_H
+#define BLOCK_COMPRESSOR_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+
+#include "thread_pool.h"
+#include "cpu_features.h"
+
+/*
+	CPU encoder for the BC (S3TC/BPTC) block compressed formats.
+
+	Each 4x4 block of pixels is stored as two endpoint colors plus one
+	small index per pixel picking a color on the line between them:
+		BC1: 8 bytes, RGB 565 endpoints, 2 bit indices (1 bit alpha)
+		BC3: 16 bytes, a BC1 color block plus 8 bytes of 3 bit alpha indices
+		BC7: 16 bytes, here always mode 6: RGBA 7777+1 endpoints, 4 bit indices
+	so the texture takes 4x (BC3, BC7) to 8x (BC1) less memory than RGBA8,
+	and the GPU reads it compressed.
+
+	The endpoints come from the principal axis of the block's colors, then
+	(depending on the quality) are refined by least squares on the chosen
+	indices. Choosing the indices (the distance of every pixel to every
+	palette color) is where the time goes, so that part has SSE2 and AVX2
+	versions, picked at runtime. Blocks are independent, so rows of blocks
+	are spread over a ThreadPool.
+*/
+namespace BlockCompression {
+
+	enum Format { FORMAT_BC1, FORMAT_BC3, FORMAT_BC7 };
+
+	enum Quality {
+		QUALITY_FAST,		// principal axis endpoints only
+		QUALITY_NORMAL,		// plus one least squares refinement
+		QUALITY_HIGH		// plus more refinement and every BC7 p-bit combination
+	};
+
+	// Instruction set used by the encoder, can be lowered (e.g. to compare speeds)
+	inline CpuFeatures::Simd simd = CpuFeatures::detect();
+
+	inline uint32_t blockBytes(Format format) {
+		return format == FORMAT_BC1 ? 8 : 16;
+	}
+
+	// ---- INDEX SELECTION ---- //
+
+	/*
+		For each of the 16 RGBA pixels, finds the palette color with the
+		smallest squared distance. Returns the summed error of the block.
+	*/
+	inline uint32_t selectIndicesScalar(const uint8_t pixels[64], const uint8_t palette[][4], int paletteSize, uint8_t indices[16]) {
+		uint32_t total = 0;
+		for (int i = 0; i < 16; i++) {
+			int best = INT_MAX, bestIndex = 0;
+			for (int j = 0; j < paletteSize; j++) {
+				int error = 0;
+				for (int c = 0; c < 4; c++) {
+					int difference = pixels[i * 4 + c] - palette[j][c];
+					error += difference * difference;
+				}
+				if (error < best) {
+					best = error;
+					bestIndex = j;
+				}
+			}
+			indices[i] = (uint8_t)bestIndex;
+			total += best;
+		}
+		return total;
+	}
+
+#ifdef CPU_FEATURES_X86
+	// Palette color widened to 16 bits per channel, as a 64 bit pattern to broadcast
+	inline long long widenColor(const uint8_t color[4]) {
+		return (long long)((uint64_t)color[0] | ((uint64_t)color[1] << 16) | ((uint64_t)color[2] << 32) | ((uint64_t)color[3] << 48));
+	}
+
+	// Two pixels per register, 16 bits per channel: madd squares and adds channel pairs
+	CPU_TARGET_SSE2 inline uint32_t selectIndicesSse2(const uint8_t pixels[64], const uint8_t palette[][4], int paletteSize, uint8_t indices[16]) {
+		__m128i colors[16];
+		for (int j = 0; j < paletteSize; j++)
+			colors[j] = _mm_set1_epi64x(widenColor(palette[j]));
+
+		const __m128i zero = _mm_setzero_si128();
+		uint32_t total = 0;
+		for (int i = 0; i < 16; i += 2) {
+			__m128i pixel = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pixels + i * 4)), zero);
+			__m128i best = _mm_set1_epi32(INT_MAX);
+			__m128i bestIndex = zero;
+			for (int j = 0; j < paletteSize; j++) {
+				__m128i difference = _mm_sub_epi16(pixel, colors[j]);
+				__m128i squares = _mm_madd_epi16(difference, difference);
+				// rg + ba of each pixel, in both of its lanes
+				__m128i error = _mm_add_epi32(squares, _mm_shuffle_epi32(squares, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m128i less = _mm_cmplt_epi32(error, best);
+				best = _mm_or_si128(_mm_and_si128(less, error), _mm_andnot_si128(less, best));
+				bestIndex = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi32(j)), _mm_andnot_si128(less, bestIndex));
+			}
+			indices[i] = (uint8_t)_mm_cvtsi128_si32(bestIndex);
+			indices[i + 1] = (uint8_t)_mm_cvtsi128_si32(_mm_srli_si128(bestIndex, 8));
+			total += (uint32_t)_mm_cvtsi128_si32(best) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(best, 8));
+		}
+		return total;
+	}
+
+	// Same with four pixels per register
+	CPU_TARGET_AVX2 inline uint32_t selectIndicesAvx2(const uint8_t pixels[64], const uint8_t palette[][4], int paletteSize, uint8_t indices[16]) {
+		__m256i colors[16];
+		for (int j = 0; j < paletteSize; j++)
+			colors[j] = _mm256_set1_epi64x(widenColor(palette[j]));
+
+		uint32_t total = 0;
+		for (int i = 0; i < 16; i += 4) {
+			__m256i pixel = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pixels + i * 4)));
+			__m256i best = _mm256_set1_epi32(INT_MAX);
+			__m256i bestIndex = _mm256_setzero_si256();
+			for (int j = 0; j < paletteSize; j++) {
+				__m256i difference = _mm256_sub_epi16(pixel, colors[j]);
+				__m256i squares = _mm256_madd_epi16(difference, difference);
+				__m256i error = _mm256_add_epi32(squares, _mm256_shuffle_epi32(squares, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m256i less = _mm256_cmpgt_epi32(best, error);
+				best = _mm256_blendv_epi8(best, error, less);
+				bestIndex = _mm256_blendv_epi8(bestIndex, _mm256_set1_epi32(j), less);
+			}
+			alignas(32) int32_t errors[8], chosen[8];
+			_mm256_store_si256((__m256i*)errors, best);
+			_mm256_store_si256((__m256i*)chosen, bestIndex);
+			for (int k = 0; k < 4; k++) {
+				indices[i + k] = (uint8_t)chosen[k * 2];
+				total += (uint32_t)errors[k * 2];
+			}
+		}
+		return total;
+	}
+#endif
+
+	inline uint32_t selectIndices(const uint8_t pixels[64], const uint8_t palette[][4], int paletteSize, uint8_t indices[16]) {
+#ifdef CPU_FEATURES_X86
+		if (simd == CpuFeatures::SIMD_AVX2)
+			return selectIndicesAvx2(pixels, palette, paletteSize, indices);
+		if (simd == CpuFeatures::SIMD_SSE2)
+			return selectIndicesSse2(pixels, palette, paletteSize, indices);
+#endif
+		return selectIndicesScalar(pixels, palette, paletteSize, indices);
+	}
+
+	// ---- ENDPOINTS ---- //
+
+	/*
+		Endpoints at both ends of the principal axis of the colors (the
+		direction they vary the most), found by power iteration on their
+		covariance. Only the first channels channels are used, pixels with
+		a zero in mask are skipped.
+	*/
+	inline void principalEndpoints(const uint8_t pixels[64], int channels, const bool* mask, float start[4], float end[4]) {
+		float mean[4] = {}, minimum[4], maximum[4];
+		int count = 0;
+		for (int c = 0; c < 4; c++) {
+			minimum[c] = 255.0f;
+			maximum[c] = 0.0f;
+		}
+		for (int i = 0; i < 16; i++) {
+			if (mask && !mask[i])
+				continue;
+			for (int c = 0; c < channels; c++) {
+				float value = pixels[i * 4 + c];
+				mean[c] += value;
+				minimum[c] = std::min(minimum[c], value);
+				maximum[c] = std::max(maximum[c], value);
+			}
+			count++;
+		}
+		for (int c = 0; c < 4; c++) {
+			start[c] = end[c] = 255.0f;
+		}
+		if (count == 0)
+			return;
+		for (int c = 0; c < channels; c++)
+			mean[c] /= count;
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++) {
+			if (mask && !mask[i])
+				continue;
+			for (int a = 0; a < channels; a++) {
+				for (int b = a; b < channels; b++)
+					covariance[a][b] += (pixels[i * 4 + a] - mean[a]) * (pixels[i * 4 + b] - mean[b]);
+			}
+		}
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < a; b++)
+				covariance[a][b] = covariance[b][a];
+		}
+
+		float axis[4] = {};
+		for (int c = 0; c < channels; c++)
+			axis[c] = maximum[c] - minimum[c];
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[4] = {};
+			float length = 0.0f;
+			for (int a = 0; a < channels; a++) {
+				for (int b = 0; b < channels; b++)
+					next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::fabs(next[a]));
+			}
+			if (length == 0.0f)
+				break;
+			for (int c = 0; c < channels; c++)
+				axis[c] = next[c] / length;
+		}
+
+		float lengthSquared = 0.0f;
+		for (int c = 0; c < channels; c++)
+			lengthSquared += axis[c] * axis[c];
+		if (lengthSquared == 0.0f) {
+			// Every pixel is the same color
+			for (int c = 0; c < channels; c++)
+				start[c] = end[c] = mean[c];
+			return;
+		}
+
+		float lowest = 1e30f, highest = -1e30f;
+		for (int i = 0; i < 16; i++) {
+			if (mask && !mask[i])
+				continue;
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++)
+				t += (pixels[i * 4 + c] - mean[c]) * axis[c];
+			lowest = std::min(lowest, t);
+			highest = std::max(highest, t);
+		}
+		for (int c = 0; c < channels; c++) {
+			start[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * lowest / lengthSquared));
+			end[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * highest / lengthSquared));
+		}
+	}
+
+	/*
+		Least squares endpoints for fixed indices: each pixel is modeled as
+		(1 - w) * start + w * end with w the weight of its index.
+		Returns false when the indices don't define a line (all the same weight).
+	*/
+	inline bool refineEndpoints(const uint8_t pixels[64], int channels, const bool* mask, const uint8_t indices[16],
+		const float* weights, float start[4], float end[4]) {
+		float a = 0.0f, b = 0.0f, c = 0.0f;
+		float x0[4] = {}, x1[4] = {};
+		for (int i = 0; i < 16; i++) {
+			if (mask && !mask[i])
+				continue;
+			float w = weights[indices[i]];
+			a += (1.0f - w) * (1.0f - w);
+			b += (1.0f - w) * w;
+			c += w * w;
+			for (int k = 0; k < channels; k++) {
+				x0[k] += (1.0f - w) * pixels[i * 4 + k];
+				x1[k] += w * pixels[i * 4 + k];
+			}
+		}
+		float determinant = a * c - b * b;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		for (int k = 0; k < channels; k++) {
+			start[k] = std::min(255.0f, std::max(0.0f, (c * x0[k] - b * x1[k]) / determinant));
+			end[k] = std::min(255.0f, std::max(0.0f, (a * x1[k] - b * x0[k]) / determinant));
+		}
+		return true;
+	}
+
+	// ---- BC1 ---- //
+
+	inline uint16_t packColor565(const float color[4]) {
+		int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+		int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+		int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	inline void unpackColor565(uint16_t packed, uint8_t color[4]) {
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (uint8_t)((r << 3) | (r >> 2));
+		color[1] = (uint8_t)((g << 2) | (g >> 4));
+		color[2] = (uint8_t)((b << 3) | (b >> 2));
+		color[3] = 255;
+	}
+
+	// The 4 (or 3 + transparent black) colors a BC1 block can pick from, as the decoder builds them
+	inline int bc1Palette(uint16_t color0, uint16_t color1, bool forceFourColors, uint8_t palette[4][4]) {
+		unpackColor565(color0, palette[0]);
+		unpackColor565(color1, palette[1]);
+		if (color0 > color1 || forceFourColors) {
+			for (int c = 0; c < 3; c++) {
+				palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+				palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+			}
+			palette[2][3] = palette[3][3] = 255;
+			return 4;
+		}
+		for (int c = 0; c < 3; c++)
+			palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+		palette[2][3] = 255;
+		palette[3][0] = palette[3][1] = palette[3][2] = palette[3][3] = 0;
+		return 3;
+	}
+
+	/*
+		Color part of BC1 and BC3. With allowTransparent, pixels with alpha
+		below 128 use the transparent index (BC1's 3 color mode).
+	*/
+	inline void encodeColorBlock(const uint8_t pixels[64], bool allowTransparent, Quality quality, uint8_t output[8]) {
+		// Alpha doesn't count in the color error
+		uint8_t colors[64];
+		bool opaque[16];
+		bool anyTransparent = false;
+		for (int i = 0; i < 16; i++) {
+			std::memcpy(colors + i * 4, pixels + i * 4, 3);
+			colors[i * 4 + 3] = 255;
+			opaque[i] = !allowTransparent || pixels[i * 4 + 3] >= 128;
+			anyTransparent |= !opaque[i];
+		}
+
+		float start[4], end[4];
+		principalEndpoints(colors, 3, opaque, start, end);
+
+		// Weight of the end color for each index
+		const float fourColorWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		const float threeColorWeights[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+
+		uint16_t bestColor0 = 0, bestColor1 = 0;
+		uint8_t bestIndices[16] = {};
+		uint32_t bestError = UINT_MAX;
+		int iterations = quality == QUALITY_FAST ? 1 : quality == QUALITY_NORMAL ? 2 : 4;
+
+		for (int iteration = 0; iteration < iterations; iteration++) {
+			uint16_t color0 = packColor565(end), color1 = packColor565(start);
+			// The order of the endpoints picks the mode: color0 > color1 is 4 colors, otherwise 3 + transparent
+			if (anyTransparent ? color0 > color1 : color0 < color1)
+				std::swap(color0, color1);
+
+			uint8_t palette[4][4];
+			int paletteSize = bc1Palette(color0, color1, false, palette);
+			uint8_t indices[16];
+			uint32_t error = selectIndices(colors, palette, anyTransparent ? 3 : paletteSize, indices);
+			if (color0 == color1) {
+				// Only one color, any 4 color index would decode to it too
+				for (int i = 0; i < 16; i++)
+					indices[i] = 0;
+			}
+			if (anyTransparent) {
+				// Transparent pixels get index 3 whatever their color, only the others count
+				error = 0;
+				for (int i = 0; i < 16; i++) {
+					if (!opaque[i]) {
+						indices[i] = 3;
+						continue;
+					}
+					for (int c = 0; c < 3; c++) {
+						int difference = colors[i * 4 + c] - palette[indices[i]][c];
+						error += difference * difference;
+					}
+				}
+			}
+
+			if (error < bestError) {
+				bestError = error;
+				bestColor0 = color0;
+				bestColor1 = color1;
+				std::memcpy(bestIndices, indices, 16);
+			}
+
+			// Fit the endpoints to the indices just chosen, start = color0
+			if (iteration + 1 < iterations) {
+				float refinedStart[4], refinedEnd[4];
+				if (!refineEndpoints(colors, 3, opaque, indices, paletteSize == 4 && !anyTransparent ? fourColorWeights : threeColorWeights, refinedStart, refinedEnd))
+					break;
+				for (int c = 0; c < 4; c++) {
+					end[c] = refinedStart[c];
+					start[c] = refinedEnd[c];
+				}
+			}
+		}
+
+		uint32_t packedIndices = 0;
+		for (int i = 0; i < 16; i++)
+			packedIndices |= (uint32_t)bestIndices[i] << (i * 2);
+		std::memcpy(output, &bestColor0, 2);
+		std::memcpy(output + 2, &bestColor1, 2);
+		std::memcpy(output + 4, &packedIndices, 4);
+	}
+
+	// ---- BC3 ---- //
+
+	inline void bc3AlphaPalette(uint8_t alpha0, uint8_t alpha1, uint8_t palette[8]) {
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		if (alpha0 > alpha1) {
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = (uint8_t)(((7 - i) * alpha0 + i * alpha1) / 7);
+		}
+		else {
+			for (int i = 1; i < 5; i++)
+				palette[i + 1] = (uint8_t)(((5 - i) * alpha0 + i * alpha1) / 5);
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	inline void encodeAlphaBlock(const uint8_t pixels[64], uint8_t output[8]) {
+		uint8_t minimum = 255, maximum = 0;
+		for (int i = 0; i < 16; i++) {
+			minimum = std::min(minimum, pixels[i * 4 + 3]);
+			maximum = std::max(maximum, pixels[i * 4 + 3]);
+		}
+
+		// 8 interpolated values between max and min
+		uint8_t palette[8];
+		bc3AlphaPalette(maximum, minimum, palette);
+		uint64_t packed = (uint64_t)maximum | ((uint64_t)minimum << 8);
+		for (int i = 0; i < 16; i++) {
+			int alpha = pixels[i * 4 + 3], best = INT_MAX, bestIndex = 0;
+			for (int j = 0; j < (maximum > minimum ? 8 : 1); j++) {
+				int difference = std::abs(alpha - palette[j]);
+				if (difference < best) {
+					best = difference;
+					bestIndex = j;
+				}
+			}
+			packed |= (uint64_t)bestIndex << (16 + i * 3);
+		}
+		std::memcpy(output, &packed, 8);
+	}
+
+	// ---- BC7 ---- //
+
+	// Weights of the 16 interpolated colors of 4 bit indices, out of 64
+	const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct BitWriter {
+		uint8_t bytes[16] = {};
+		int position = 0;
+
+		void put(uint32_t value, int bits) {
+			for (int i = 0; i < bits; i++, position++) {
+				if (value >> i & 1)
+					bytes[position / 8] |= (uint8_t)(1 << (position % 8));
+			}
+		}
+	};
+
+	struct BitReader {
+		const uint8_t* bytes;
+		int position = 0;
+
+		uint32_t get(int bits) {
+			uint32_t value = 0;
+			for (int i = 0; i < bits; i++, position++)
+				value |= (uint32_t)(bytes[position / 8] >> (position % 8) & 1) << i;
+			return value;
+		}
+	};
+
+	struct Bc7Endpoints {
+		uint8_t quantized[2][4];	// 7 bits per channel
+		uint8_t pBit[2];
+	};
+
+	inline void bc7Quantize(const float start[4], const float end[4], int pBit0, int pBit1, Bc7Endpoints& endpoints) {
+		const float* colors[2] = { start, end };
+		int pBits[2] = { pBit0, pBit1 };
+		for (int e = 0; e < 2; e++) {
+			for (int c = 0; c < 4; c++) {
+				// The stored 8 bit value is (q << 1) | pBit
+				int q = (int)std::lround((colors[e][c] - pBits[e]) / 2.0f);
+				endpoints.quantized[e][c] = (uint8_t)std::min(127, std::max(0, q));
+			}
+			endpoints.pBit[e] = (uint8_t)pBits[e];
+		}
+	}
+
+	// p-bit giving the 8 bit value closest to the endpoint, for when they aren't all tried
+	inline int bc7ClosestPBit(const float color[4]) {
+		float errors[2] = {};
+		for (int p = 0; p < 2; p++) {
+			for (int c = 0; c < 4; c++) {
+				int q = std::min(127, std::max(0, (int)std::lround((color[c] - p) / 2.0f)));
+				float difference = (float)((q << 1) | p) - color[c];
+				errors[p] += difference * difference;
+			}
+		}
+		return errors[1] < errors[0] ? 1 : 0;
+	}
+
+	inline void bc7Palette(const Bc7Endpoints& endpoints, uint8_t palette[16][4]) {
+		int e0[4], e1[4];
+		for (int c = 0; c < 4; c++) {
+			e0[c] = (endpoints.quantized[0][c] << 1) | endpoints.pBit[0];
+			e1[c] = (endpoints.quantized[1][c] << 1) | endpoints.pBit[1];
+		}
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 4; c++)
+				palette[i][c] = (uint8_t)(((64 - bc7Weights[i]) * e0[c] + bc7Weights[i] * e1[c] + 32) >> 6);
+		}
+	}
+
+	inline void encodeBc7Block(const uint8_t pixels[64], Quality quality, uint8_t output[16]) {
+		float start[4], end[4];
+		principalEndpoints(pixels, 4, nullptr, start, end);
+
+		float weights[16];
+		for (int i = 0; i < 16; i++)
+			weights[i] = bc7Weights[i] / 64.0f;
+
+		Bc7Endpoints best = {};
+		uint8_t bestIndices[16] = {};
+		uint32_t bestError = UINT_MAX;
+		int iterations = quality == QUALITY_FAST ? 1 : quality == QUALITY_NORMAL ? 2 : 4;
+
+		for (int iteration = 0; iteration < iterations; iteration++) {
+			// Below the high preset only the p-bits closest to each endpoint are tried
+			int combinations = quality == QUALITY_HIGH ? 4 : 1;
+			for (int combination = 0; combination < combinations; combination++) {
+				int pBit0 = combinations == 1 ? bc7ClosestPBit(start) : combination & 1;
+				int pBit1 = combinations == 1 ? bc7ClosestPBit(end) : combination >> 1;
+
+				Bc7Endpoints endpoints;
+				bc7Quantize(start, end, pBit0, pBit1, endpoints);
+				uint8_t palette[16][4];
+				bc7Palette(endpoints, palette);
+				uint8_t indices[16];
+				uint32_t error = selectIndices(pixels, palette, 16, indices);
+				if (error < bestError) {
+					bestError = error;
+					best = endpoints;
+					std::memcpy(bestIndices, indices, 16);
+				}
+			}
+			if (bestError == 0 || iteration + 1 == iterations)
+				break;
+			if (!refineEndpoints(pixels, 4, nullptr, bestIndices, weights, start, end))
+				break;
+		}
+
+		// The first index has only 3 bits stored, its top bit must be 0: swap the endpoints if it isn't
+		if (bestIndices[0] & 8) {
+			std::swap(best.quantized[0], best.quantized[1]);
+			std::swap(best.pBit[0], best.pBit[1]);
+			for (int i = 0; i < 16; i++)
+				bestIndices[i] = (uint8_t)(15 - bestIndices[i]);
+		}
+
+		BitWriter bits;
+		bits.put(1 << 6, 7);	// mode 6
+		for (int c = 0; c < 4; c++) {
+			bits.put(best.quantized[0][c], 7);
+			bits.put(best.quantized[1][c], 7);
+		}
+		bits.put(best.pBit[0], 1);
+		bits.put(best.pBit[1], 1);
+		bits.put(bestIndices[0], 3);
+		for (int i = 1; i < 16; i++)
+			bits.put(bestIndices[i], 4);
+		std::memcpy(output, bits.bytes, 16);
+	}
+
+	// ---- DECODING (to check the quality) ---- //
+
+	inline void decodeBc1Block(const uint8_t block[8], bool forceFourColors, uint8_t pixels[64]) {
+		uint16_t color0, color1;
+		uint32_t indices;
+		std::memcpy(&color0, block, 2);
+		std::memcpy(&color1, block + 2, 2);
+		std::memcpy(&indices, block + 4, 4);
+		uint8_t palette[4][4];
+		bc1Palette(color0, color1, forceFourColors, palette);
+		for (int i = 0; i < 16; i++)
+			std::memcpy(pixels + i * 4, palette[indices >> (i * 2) & 3], 4);
+	}
+
+	inline void decodeBc3Block(const uint8_t block[16], uint8_t pixels[64]) {
+		decodeBc1Block(block + 8, true, pixels);
+		uint64_t alpha;
+		std::memcpy(&alpha, block, 8);
+		uint8_t palette[8];
+		bc3AlphaPalette(block[0], block[1], palette);
+		for (int i = 0; i < 16; i++)
+			pixels[i * 4 + 3] = palette[alpha >> (16 + i * 3) & 7];
+	}
+
+	// Only mode 6, the one encodeBc7Block writes. Other modes decode as opaque magenta
+	inline void decodeBc7Block(const uint8_t block[16], uint8_t pixels[64]) {
+		BitReader bits = { block };
+		if (bits.get(7) != (1 << 6)) {
+			for (int i = 0; i < 16; i++) {
+				const uint8_t magenta[4] = { 255, 0, 255, 255 };
+				std::memcpy(pixels + i * 4, magenta, 4);
+			}
+			return;
+		}
+		Bc7Endpoints endpoints;
+		for (int c = 0; c < 4; c++) {
+			endpoints.quantized[0][c] = (uint8_t)bits.get(7);
+			endpoints.quantized[1][c] = (uint8_t)bits.get(7);
+		}
+		endpoints.pBit[0] = (uint8_t)bits.get(1);
+		endpoints.pBit[1] = (uint8_t)bits.get(1);
+		uint8_t palette[16][4];
+		bc7Palette(endpoints, palette);
+		for (int i = 0; i < 16; i++)
+			std::memcpy(pixels + i * 4, palette[bits.get(i == 0 ? 3 : 4)], 4);
+	}
+
+	// ---- WHOLE IMAGES ---- //
+
+	inline void encodeBlock(Format format, Quality quality, const uint8_t pixels[64], uint8_t* output) {
+		if (format == FORMAT_BC1)
+			encodeColorBlock(pixels, true, quality, output);
+		else if (format == FORMAT_BC3) {
+			encodeAlphaBlock(pixels, output);
+			encodeColorBlock(pixels, false, quality, output + 8);
+		}
+		else
+			encodeBc7Block(pixels, quality, output);
+	}
+
+	/*
+		Compresses an RGBA8 image, rows of blocks are spread over the pool
+		(or done on this thread without one). Sizes that aren't multiples
+		of 4 repeat the last row/column to fill the edge blocks.
+	*/
+	inline std::vector<uint8_t> compress(const uint8_t* rgba, uint32_t width, uint32_t height, Format format, Quality quality, ThreadPool* pool = nullptr) {
+		uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		std::vector<uint8_t> output((size_t)blocksX * blocksY * blockBytes(format));
+
+		auto encodeRows = [&](size_t firstRow, size_t lastRow) {
+			uint8_t pixels[64];
+			for (size_t by = firstRow; by < lastRow; by++) {
+				for (uint32_t bx = 0; bx < blocksX; bx++) {
+					for (uint32_t y = 0; y < 4; y++) {
+						uint32_t sourceY = std::min((uint32_t)by * 4 + y, height - 1);
+						for (uint32_t x = 0; x < 4; x++) {
+							uint32_t sourceX = std::min(bx * 4 + x, width - 1);
+							std::memcpy(pixels + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+						}
+					}
+					encodeBlock(format, quality, pixels, output.data() + (by * blocksX + bx) * blockBytes(format));
+				}
+			}
+		};
+
+		if (pool)
+			pool->parallelFor(blocksY, 4, encodeRows);
+		else
+			encodeRows(0, blocksY);
+		return output;
+	}
+
+	inline std::vector<uint8_t> decompress(const uint8_t* blocks, uint32_t width, uint32_t height, Format format) {
+		uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		std::vector<uint8_t> rgba((size_t)width * height * 4);
+		uint8_t pixels[64];
+		for (uint32_t by = 0; by < blocksY; by++) {
+			for (uint32_t bx = 0; bx < blocksX; bx++) {
+				const uint8_t* block = blocks + ((size_t)by * blocksX + bx) * blockBytes(format);
+				if (format == FORMAT_BC1)
+					decodeBc1Block(block, false, pixels);
+				else if (format == FORMAT_BC3)
+					decodeBc3Block(block, pixels);
+				else
+					decodeBc7Block(block, pixels);
+				for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++) {
+					for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++)
+						std::memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], pixels + (y * 4 + x) * 4, 4);
+				}
+			}
+		}
+		return rgba;
+	}
+
+	// Peak signal to noise ratio in dB over every channel, higher is closer (inf if identical)
+	inline double psnr(const uint8_t* a, const uint8_t* b, size_t bytes) {
+		double squaredError = 0.0;
+		for (size_t i = 0; i < bytes; i++) {
+			double difference = (double)a[i] - b[i];
+			squaredError += difference * difference;
+		}
+		if (squaredError == 0.0)
+			return INFINITY;
+		return 10.0 * std::log10(255.0 * 255.0 * bytes / squaredError);
+	}
+}
+
+#endif
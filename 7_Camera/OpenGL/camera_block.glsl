@@ -0,0 +1,6 @@
+// Shared camera matrices, filled once per frame by CameraBlock (camera_block.h)
+layout (std140, binding = 0) uniform CameraBlock
+{
+	mat4 view;
+	mat4 projection;
+};
@@ -0,0 +1,91 @@
+#ifndef CAMERA_BLOCK_H
+#define CAMERA_BLOCK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstddef>
+
+// Uniform buffer binding point every Shader connects its CameraBlock to
+#define CAMERA_BLOCK_BINDING 0
+
+/*
+	Camera matrices shared by every shader program through a uniform buffer.
+
+	Without it each program gets its own copy of view and projection with
+	glUniformMatrix4fv every frame, so N programs cost 2*N uploads even though
+	the projection hardly ever changes. With it, the matrices are written
+	once per frame into a buffer that every program reads from.
+
+	The GLSL side is camera_block.glsl, it must keep the same layout as
+	CameraBlockData (std140: a mat4 is four vec4 columns, no padding needed).
+*/
+struct CameraBlockData {
+	glm::mat4 view;
+	glm::mat4 projection;
+};
+
+class CameraBlock {
+
+public:
+	// Uniform buffer object ID
+	unsigned int UBO;
+
+	// Programs currently linked with a CameraBlock (kept up to date by Shader)
+	static inline unsigned int programCount = 0;
+
+	// glUniformMatrix4fv calls that would've been made without the block, minus buffer uploads done
+	unsigned long long uniformCallsSaved = 0;
+	unsigned long long bufferUploads = 0;
+
+	CameraBlock() {
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlockData), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		// Connect the buffer to the binding point the programs read from
+		glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, UBO);
+	}
+
+	void setView(const glm::mat4& view) {
+		if (view != data.view) {
+			data.view = view;
+			viewDirty = true;
+		}
+	}
+
+	void setProjection(const glm::mat4& projection) {
+		if (projection != data.projection) {
+			data.projection = projection;
+			projectionDirty = true;
+		}
+	}
+
+	// Call once per frame after setting the matrices, only uploads what changed
+	void update() {
+		unsigned int uploads = 0;
+		if (viewDirty || projectionDirty) {
+			glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+			// view and projection are next to each other, so one upload covers both when both changed
+			size_t offset = viewDirty ? offsetof(CameraBlockData, view) : offsetof(CameraBlockData, projection);
+			size_t end = projectionDirty ? sizeof(CameraBlockData) : offsetof(CameraBlockData, projection);
+			glBufferSubData(GL_UNIFORM_BUFFER, offset, end - offset, (const char*)&data + offset);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			uploads = 1;
+			viewDirty = projectionDirty = false;
+		}
+
+		bufferUploads += uploads;
+		if (2 * programCount > uploads)
+			uniformCallsSaved += 2 * programCount - uploads;
+	}
+
+private:
+	CameraBlockData data = { glm::mat4(1.0f), glm::mat4(1.0f) };
+	bool viewDirty = true;
+	bool projectionDirty = true;
+};
+
+#endif
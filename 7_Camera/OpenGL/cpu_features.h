@@ -0,0 +1,57 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_FEATURES_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need the functions using SSE2/AVX2 marked, the rest of the code stays baseline
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_TARGET_SSE2 __attribute__((target("sse2")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CPU_TARGET_SSE2
+#define CPU_TARGET_AVX2
+#endif
+
+/*
+	Which SIMD instruction sets the CPU running the program has, so the
+	code can be built for any x86 CPU and still use AVX2 where it exists.
+	Other CPUs (e.g. ARM) use the scalar versions.
+*/
+namespace CpuFeatures {
+
+	enum Simd { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+	inline Simd detect() {
+#if defined(CPU_FEATURES_X86) && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return SIMD_AVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return SIMD_SSE2;
+#elif defined(CPU_FEATURES_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		// AVX registers are only usable if the OS saves them (OSXSAVE and XCR0)
+		bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		__cpuidex(info, 7, 0);
+		if (osSavesYmm && (info[1] & (1 << 5)))
+			return SIMD_AVX2;
+		if (sse2)
+			return SIMD_SSE2;
+#endif
+		return SIMD_SCALAR;
+	}
+
+	inline const char* name(Simd level) {
+		return level == SIMD_AVX2 ? "AVX2" : level == SIMD_SSE2 ? "SSE2" : "scalar";
+	}
+}
+
+#endif
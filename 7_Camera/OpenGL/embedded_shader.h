@@ -0,0 +1,24 @@
+#ifndef EMBEDDED_SHADER_H
+#define EMBEDDED_SHADER_H
+
+#include <string_view>
+#include <cstdint>
+
+/*
+	A shader source file compiled into the executable.
+
+	embedded_shaders.h is generated by Tools/ShaderEmbed from the .vs/.fs/.glsl
+	files, so the program doesn't need to open and copy them at runtime.
+	The source is a string literal, so data() is null terminated and can go
+	straight to glShaderSource. hash is the 64 bit FNV-1a of the contents
+	(the same hash ProgramCache uses), computed when the file was embedded.
+*/
+struct EmbeddedShader {
+	std::string_view name;
+	std::string_view source;
+	uint64_t hash;
+	// Whether the source has #include lines that still need the preprocessor
+	bool hasIncludes;
+};
+
+#endif
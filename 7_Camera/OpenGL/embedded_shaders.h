@@ -0,0 +1,248 @@
+// Generated by Tools/ShaderEmbed, don't edit by hand.
+#ifndef EMBEDDED_SHADERS_H
+#define EMBEDDED_SHADERS_H
+
+#include "embedded_shader.h"
+
+namespace EmbeddedShaders {
+
+	inline constexpr EmbeddedShader shader_vs = {
+		"shader.vs",
+		R"GLSL(#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+
+layout (location = 0) out vec2 TexCoord;
+// Needed when this is linked as a separable stage (ShaderPipeline)
+out gl_PerVertex { vec4 gl_Position; };
+layout (location = 0) uniform mat4 model;
+#include "camera_block.glsl"
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	TexCoord = aTexCoord;
+}
+
+)GLSL",
+		0x7516fbaa165d8ed2ull,
+		true
+	};
+
+	inline constexpr EmbeddedShader shader_fs = {
+		"shader.fs",
+		R"GLSL(#version 460 core
+#ifdef BINDLESS
+// Textures are sampled through handles from the material table, never bound
+#extension GL_ARB_bindless_texture : require
+#endif
+layout (location = 0) out vec4 FragColor;
+
+layout (location = 0) in vec2 TexCoord;
+
+// Explicit bindings and locations, SPIR-V shaders have no names to look them up by
+#include "material_table.glsl"
+
+// Index in the material table, the only thing set per draw
+layout (location = 2) uniform int materialId;
+
+// How much of texture2 is mixed in, either fixed at compile time or set from the program
+#ifdef USE_MIX_UNIFORM
+layout (location = 1) uniform float mixAmount;
+#else
+#ifndef MIX_AMOUNT
+#define MIX_AMOUNT 0.2
+#endif
+const float mixAmount = MIX_AMOUNT;
+#endif
+
+void main()
+{
+	Material material = materials[materialId];
+	FragColor = mix(sampleMaterial(material.textures[0], TexCoord),
+					sampleMaterial(material.textures[1], TexCoord), mixAmount);
+}
+
+)GLSL",
+		0xea852e81b8ce61e5ull,
+		true
+	};
+
+	inline constexpr EmbeddedShader camera_block_glsl = {
+		"camera_block.glsl",
+		R"GLSL(// Shared camera matrices, filled once per frame by CameraBlock (camera_block.h)
+layout (std140, binding = 0) uniform CameraBlock
+{
+	mat4 view;
+	mat4 projection;
+};
+)GLSL",
+		0xfb77e50923277a7dull,
+		false
+	};
+
+	inline constexpr EmbeddedShader material_table_glsl = {
+		"material_table.glsl",
+		R"GLSL(// Material table, filled by MaterialTable (material_table.h), same std430 layout as MaterialData
+struct MaterialTexture
+{
+	uvec2 handle;	// bindless handle of the texture array
+	uint array;		// unit of the texture array, without bindless
+	float layer;
+	vec4 uvRect;	// UV offset (xy) and scale (zw) inside the layer
+};
+
+struct Material
+{
+	MaterialTexture textures[2];
+};
+
+layout (std430, binding = 0) readonly buffer MaterialTable
+{
+	Material materials[];
+};
+
+#ifndef BINDLESS
+// Every texture array the materials use, bound to units 0 to 7
+layout (binding = 0) uniform sampler2DArray textureArrays[8];
+#endif
+
+// The material index is the same for the whole draw, so indexing textureArrays with it is allowed
+vec4 sampleMaterial(MaterialTexture materialTexture, vec2 uv)
+{
+	vec3 coords = vec3(materialTexture.uvRect.xy + uv * materialTexture.uvRect.zw, materialTexture.layer);
+#ifdef BINDLESS
+	return texture(sampler2DArray(materialTexture.handle), coords);
+#else
+	return texture(textureArrays[materialTexture.array], coords);
+#endif
+}
+)GLSL",
+		0x673c2af53b642b97ull,
+		false
+	};
+
+	inline constexpr EmbeddedShader virtual_fs = {
+		"virtual.fs",
+		R"GLSL(#version 460 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
+layout (location = 0) out vec4 FragColor;
+
+layout (location = 0) in vec2 TexCoord;
+
+// shader.fs with texture1 streamed from a virtual texture
+#include "virtual_texture.glsl"
+#include "material_table.glsl"
+
+layout (location = 2) uniform int materialId;
+
+// Same as shader.fs: fixed at compile time or set from the program
+#ifdef USE_MIX_UNIFORM
+layout (location = 1) uniform float mixAmount;
+#else
+#ifndef MIX_AMOUNT
+#define MIX_AMOUNT 0.2
+#endif
+const float mixAmount = MIX_AMOUNT;
+#endif
+
+void main()
+{
+	Material material = materials[materialId];
+	FragColor = mix(sampleVirtual(TexCoord),
+					sampleMaterial(material.textures[1], TexCoord), mixAmount);
+}
+)GLSL",
+		0x6de96a1cf19346c2ull,
+		true
+	};
+
+	inline constexpr EmbeddedShader virtual_feedback_fs = {
+		"virtual_feedback.fs",
+		R"GLSL(#version 460 core
+// Feedback pass of the virtual texture, drawn into VirtualTexture's small framebuffer
+layout (location = 0) out uint Feedback;
+
+layout (location = 0) in vec2 TexCoord;
+
+#include "virtual_texture.glsl"
+
+void main()
+{
+	Feedback = virtualFeedback(TexCoord);
+}
+)GLSL",
+		0x97fa50522bf1fb48ull,
+		true
+	};
+
+	inline constexpr EmbeddedShader virtual_texture_glsl = {
+		"virtual_texture.glsl",
+		R"GLSL(// Virtual texture sampling, the textures and uniforms are set by VirtualTexture (virtual_texture.h)
+// Per tile of every level: cache slot (xy) and the level of the tile actually there (z)
+layout (binding = 8) uniform usampler2D virtualPageTable;
+// Tiles in the cache, each with a border so it can be filtered on its own
+layout (binding = 9) uniform sampler2D virtualCache;
+// Width and height of level 0, tile size and border, in texels
+layout (location = 10) uniform vec4 virtualInfo;
+// Added to the level, the feedback pass is drawn smaller so its derivatives are bigger
+layout (location = 11) uniform float virtualLodBias;
+
+// Mip level a pixel needs, from how many texels it covers
+int virtualLevel(vec2 uv)
+{
+	vec2 texels = uv * virtualInfo.xy;
+	vec2 dx = dFdx(texels), dy = dFdy(texels);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + virtualLodBias;
+	return clamp(int(floor(lod)), 0, textureQueryLevels(virtualPageTable) - 1);
+}
+
+ivec2 virtualTile(vec2 uv, int level)
+{
+	ivec2 tiles = textureSize(virtualPageTable, level);
+	return clamp(ivec2(uv * virtualInfo.xy / (virtualInfo.z * exp2(float(level)))), ivec2(0), tiles - 1);
+}
+
+vec4 sampleVirtual(vec2 uv)
+{
+	uv = clamp(uv, 0.0, 1.0);
+	int level = virtualLevel(uv);
+	uvec4 entry = texelFetch(virtualPageTable, virtualTile(uv, level), level);
+
+	// It may be a coarser tile, standing in until the wanted one is streamed in
+	int mapped = int(entry.z);
+	vec2 texels = uv * virtualInfo.xy / exp2(float(mapped));
+	vec2 inTile = texels - virtualInfo.z * vec2(virtualTile(uv, mapped));
+	float padded = virtualInfo.z + 2.0 * virtualInfo.w;
+	vec2 physical = vec2(entry.xy) * padded + virtualInfo.w + inTile;
+	return textureLod(virtualCache, physical / vec2(textureSize(virtualCache, 0)), 0.0);
+}
+
+// What the feedback pass writes: the level, y and x of the tile wanted, in 4, 14 and 14 bits
+uint virtualFeedback(vec2 uv)
+{
+	uv = clamp(uv, 0.0, 1.0);
+	int level = virtualLevel(uv);
+	ivec2 tile = virtualTile(uv, level);
+	return (uint(level) << 28) | (uint(tile.y) << 14) | uint(tile.x);
+}
+)GLSL",
+		0x14c61373de3dffa2ull,
+		false
+	};
+
+	// Every embedded file, for looking them up by name
+	inline constexpr EmbeddedShader all[] = {
+		shader_vs,
+		shader_fs,
+		camera_block_glsl,
+		material_table_glsl,
+		virtual_fs,
+		virtual_feedback_fs,
+		virtual_texture_glsl
+	};
+}
+
+#endif
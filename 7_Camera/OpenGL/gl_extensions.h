@@ -0,0 +1,26 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+/*
+	Whether the current context reports an extension, e.g.
+		hasGLExtension("GL_ARB_bindless_texture")
+	glad is generated without extensions, so their functions are
+	loaded by hand (with the loadProc given to gladLoadGLLoader)
+	once this says the driver has them.
+*/
+inline bool hasGLExtension(const char* name) {
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension != NULL && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+/*
+	Thin layer between the lessons and glad that remembers the state it set,
+	so calls that wouldn't change anything are never sent to the driver.
+	e.g. Shader::use() every frame with the same program, or binding the
+	same textures and VAO again at the start of every loop iteration.
+
+	It only works if this state is always changed through here: a direct
+	glBindTexture/glUseProgram/... makes the cache wrong. After code that
+	does that (or a context switch), call GLState::invalidate().
+
+	It tracks the state of the context current on the main thread only.
+*/
+namespace GLState {
+
+	constexpr int maxTextureUnits = 32;
+
+	struct Counters {
+		unsigned int issued = 0;
+		unsigned int elided = 0;
+	};
+
+	// Counters of the frame in progress, and of the last complete one
+	inline Counters frame;
+	inline Counters lastFrame;
+
+	struct Cache {
+		bool valid = false;
+		unsigned int program = 0;
+		unsigned int programPipeline = 0;
+		unsigned int vertexArray = 0;
+		unsigned int activeTexture = 0; // unit index, not GL_TEXTUREi
+		unsigned int texture2D[maxTextureUnits] = {};
+		unsigned int texture2DArray[maxTextureUnits] = {};
+		bool depthTest = false;
+		bool blend = false;
+		GLenum blendSource = GL_ONE;
+		GLenum blendDestination = GL_ZERO;
+		int viewport[4] = {};
+	};
+	inline Cache cache;
+
+	// Start of a new frame, keeps the counters of the one that just ended
+	inline void beginFrame() {
+		lastFrame = frame;
+		frame = Counters();
+	}
+
+	// Forget everything, the state is read again from the context on the next call
+	inline void invalidate() {
+		cache.valid = false;
+	}
+
+	// Reads the current state from the context, done automatically on first use
+	inline void sync() {
+		int value;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+		cache.program = value;
+		glGetIntegerv(GL_PROGRAM_PIPELINE_BINDING, &value);
+		cache.programPipeline = value;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+		cache.vertexArray = value;
+
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &value);
+		unsigned int active = value - GL_TEXTURE0;
+		for (unsigned int unit = 0; unit < maxTextureUnits; unit++) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glGetIntegerv(GL_TEXTURE_BINDING_2D, &value);
+			cache.texture2D[unit] = value;
+			glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &value);
+			cache.texture2DArray[unit] = value;
+		}
+		glActiveTexture(GL_TEXTURE0 + active);
+		cache.activeTexture = active;
+
+		cache.depthTest = glIsEnabled(GL_DEPTH_TEST) == GL_TRUE;
+		cache.blend = glIsEnabled(GL_BLEND) == GL_TRUE;
+		glGetIntegerv(GL_BLEND_SRC_RGB, &value);
+		cache.blendSource = value;
+		glGetIntegerv(GL_BLEND_DST_RGB, &value);
+		cache.blendDestination = value;
+		glGetIntegerv(GL_VIEWPORT, cache.viewport);
+
+		cache.valid = true;
+	}
+
+	// Returns whether the call has to be issued, and counts it
+	inline bool changed(bool differs) {
+		if (differs)
+			frame.issued++;
+		else
+			frame.elided++;
+		return differs;
+	}
+
+	inline void useProgram(unsigned int program) {
+		if (!cache.valid)
+			sync();
+		if (changed(cache.program != program)) {
+			glUseProgram(program);
+			cache.program = program;
+		}
+	}
+
+	inline void bindProgramPipeline(unsigned int pipeline) {
+		if (!cache.valid)
+			sync();
+		if (changed(cache.programPipeline != pipeline)) {
+			glBindProgramPipeline(pipeline);
+			cache.programPipeline = pipeline;
+		}
+	}
+
+	inline void bindVertexArray(unsigned int vertexArray) {
+		if (!cache.valid)
+			sync();
+		if (changed(cache.vertexArray != vertexArray)) {
+			glBindVertexArray(vertexArray);
+			cache.vertexArray = vertexArray;
+		}
+	}
+
+	inline void activeTexture(unsigned int unit) {
+		if (!cache.valid)
+			sync();
+		if (changed(cache.activeTexture != unit)) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			cache.activeTexture = unit;
+		}
+	}
+
+	/*
+		Binds a texture to a texture unit (0, 1, ... not GL_TEXTURE0).
+		The active unit is only switched if that binding actually changes.
+		Targets other than 2D and 2D array aren't cached.
+	*/
+	inline void bindTexture(unsigned int unit, GLenum target, unsigned int texture) {
+		if (!cache.valid)
+			sync();
+		unsigned int* bound = NULL;
+		if (unit < maxTextureUnits) {
+			if (target == GL_TEXTURE_2D)
+				bound = &cache.texture2D[unit];
+			else if (target == GL_TEXTURE_2D_ARRAY)
+				bound = &cache.texture2DArray[unit];
+		}
+
+		if (bound == NULL) {
+			activeTexture(unit);
+			frame.issued++;
+			glBindTexture(target, texture);
+			return;
+		}
+
+		if (changed(*bound != texture)) {
+			activeTexture(unit);
+			glBindTexture(target, texture);
+			*bound = texture;
+		}
+	}
+
+	// Deleted textures are unbound by GL, the cache has to know too
+	inline void deleteTextures(int count, const unsigned int* textures) {
+		for (int i = 0; i < count; i++) {
+			for (unsigned int unit = 0; unit < maxTextureUnits; unit++) {
+				if (cache.texture2D[unit] == textures[i])
+					cache.texture2D[unit] = 0;
+				if (cache.texture2DArray[unit] == textures[i])
+					cache.texture2DArray[unit] = 0;
+			}
+		}
+		glDeleteTextures(count, textures);
+	}
+
+	inline void deleteVertexArrays(int count, const unsigned int* vertexArrays) {
+		for (int i = 0; i < count; i++) {
+			if (cache.vertexArray == vertexArrays[i])
+				cache.vertexArray = 0;
+		}
+		glDeleteVertexArrays(count, vertexArrays);
+	}
+
+	// A deleted program stays in use until another one is, but its ID may be reused
+	inline void forgetProgram(unsigned int program) {
+		if (cache.program == program)
+			cache.program = 0xFFFFFFFF; // no real ID, so the next useProgram is issued
+	}
+
+	inline void setDepthTest(bool enabled) {
+		if (!cache.valid)
+			sync();
+		if (changed(cache.depthTest != enabled)) {
+			if (enabled)
+				glEnable(GL_DEPTH_TEST);
+			else
+				glDisable(GL_DEPTH_TEST);
+			cache.depthTest = enabled;
+		}
+	}
+
+	inline void setBlend(bool enabled) {
+		if (!cache.valid)
+			sync();
+		if (changed(cache.blend != enabled)) {
+			if (enabled)
+				glEnable(GL_BLEND);
+			else
+				glDisable(GL_BLEND);
+			cache.blend = enabled;
+		}
+	}
+
+	inline void blendFunc(GLenum source, GLenum destination) {
+		if (!cache.valid)
+			sync();
+		if (changed(cache.blendSource != source || cache.blendDestination != destination)) {
+			glBlendFunc(source, destination);
+			cache.blendSource = source;
+			cache.blendDestination = destination;
+		}
+	}
+
+	inline void viewport(int x, int y, int width, int height) {
+		if (!cache.valid)
+			sync();
+		int* current = cache.viewport;
+		if (changed(current[0] != x || current[1] != y || current[2] != width || current[3] != height)) {
+			glViewport(x, y, width, height);
+			current[0] = x;
+			current[1] = y;
+			current[2] = width;
+			current[3] = height;
+		}
+	}
+}
+
+#endif
@@ -4,5 +4,15 @@
 	turning it into a .cpp.
 */
 
+/*
+	stb_image allocates through these, so the decodes running in an
+	ImageArena::Scope (the TextureLoader workers) use their thread's arena
+	instead of the global heap.
+*/
+#include "image_arena.h"
+#define STBI_MALLOC(size) ImageArena::allocate(size)
+#define STBI_REALLOC(pointer, size) ImageArena::reallocate(pointer, size)
+#define STBI_FREE(pointer) ImageArena::release(pointer)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
\ No newline at end of file
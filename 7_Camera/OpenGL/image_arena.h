@@ -0,0 +1,227 @@
+#ifndef IMAGE_ARENA_H
+#define IMAGE_ARENA_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+
+/*
+	Allocator behind stb_image's STBI_MALLOC / STBI_REALLOC / STBI_FREE
+	(see image.cpp).
+
+	Decoding one image makes stb_image allocate and free several big
+	buffers (JPEG component planes, the PNG zlib output that keeps growing
+	with realloc, the final pixels...). With many textures decoding at once
+	on the loader's workers, that's a lot of malloc/free of a few MB each,
+	all going through the same global heap, which fragments it and makes
+	the threads wait on each other.
+
+	Instead, every thread has its own arena: allocations are a bump of an
+	offset in a block the thread owns, freeing does nothing (except giving
+	back the last allocation, so a realloc of it can grow in place), and
+	the whole arena is reset in one go when the decode is done. After the
+	first few images the blocks are big enough and no memory is asked to
+	the heap anymore.
+
+	The arena is only used inside an ImageArena::Scope, outside of one the
+	hooks call malloc/free as before. Everything stb_image returns inside
+	the scope (the pixels too) is gone when the scope ends, so copy it out
+	first:
+
+		{
+			ImageArena::Scope scope;
+			unsigned char* pixels = stbi_load(...);
+			// copy pixels somewhere else
+			stbi_image_free(pixels);
+		}
+*/
+namespace ImageArena {
+
+	// Before every allocation, keeps the memory 16 byte aligned
+	struct alignas(16) Header {
+		size_t size;
+		// 0 for malloc, 1 for the arena
+		size_t owner;
+	};
+
+	class Arena {
+
+	public:
+		// Biggest the arena got, a block of that size is kept between decodes
+		size_t peakBytes = 0;
+		// Blocks asked to the heap, stops growing once the arena is big enough
+		unsigned int blockAllocations = 0;
+
+		Arena() {}
+
+		~Arena() {
+			for (Block& block : blocks)
+				std::free(block.memory);
+		}
+
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		// Header included, size is rounded to keep the alignment
+		Header* allocate(size_t size) {
+			size = (size + 15) & ~(size_t)15;
+			if (blocks.empty() || blocks.back().used + size > blocks.back().size) {
+				size_t blockSize = std::max(size, blocks.empty() ? minimumBlock : blocks.back().size * 2);
+				Block block = { (unsigned char*)std::malloc(blockSize), blockSize, 0 };
+				if (block.memory == nullptr)
+					return nullptr;
+				blocks.push_back(block);
+				blockAllocations++;
+			}
+			Block& block = blocks.back();
+			Header* header = (Header*)(block.memory + block.used);
+			block.used += size;
+			used += size;
+			peakBytes = std::max(peakBytes, used);
+			return header;
+		}
+
+		// Grows the allocation where it is if it's the last one and there is room, false otherwise
+		bool grow(Header* header, size_t size) {
+			size = (size + 15) & ~(size_t)15;
+			if (!isLast(header))
+				return false;
+			Block& block = blocks.back();
+			size_t start = (unsigned char*)header - block.memory;
+			if (start + size > block.size)
+				return false;
+			used += size - (block.used - start);
+			block.used = start + size;
+			peakBytes = std::max(peakBytes, used);
+			return true;
+		}
+
+		// Only the last allocation can really be given back
+		void release(Header* header) {
+			if (!isLast(header))
+				return;
+			Block& block = blocks.back();
+			size_t start = (unsigned char*)header - block.memory;
+			used -= block.used - start;
+			block.used = start;
+		}
+
+		/*
+			Frees everything at once. If the decode needed more than one
+			block, they're replaced by a single one as big as the peak, so
+			the next decode of the same size fits in it.
+		*/
+		void reset() {
+			if (blocks.size() > 1) {
+				for (Block& block : blocks)
+					std::free(block.memory);
+				blocks.clear();
+				size_t blockSize = (peakBytes + 15) & ~(size_t)15;
+				Block block = { (unsigned char*)std::malloc(blockSize), blockSize, 0 };
+				if (block.memory != nullptr) {
+					blocks.push_back(block);
+					blockAllocations++;
+				}
+			}
+			else if (!blocks.empty())
+				blocks.back().used = 0;
+			used = 0;
+		}
+
+	private:
+		struct Block {
+			unsigned char* memory;
+			size_t size;
+			size_t used;
+		};
+
+		static const size_t minimumBlock = 4 * 1024 * 1024;
+
+		std::vector<Block> blocks;
+		size_t used = 0;
+
+		bool isLast(Header* header) const {
+			if (blocks.empty())
+				return false;
+			const Block& block = blocks.back();
+			unsigned char* start = (unsigned char*)header;
+			return start >= block.memory && start < block.memory + block.used
+				&& start + ((header->size + sizeof(Header) + 15) & ~(size_t)15) == block.memory + block.used;
+		}
+	};
+
+	// Each thread's arena, and the one the hooks use right now (null outside a Scope)
+	inline thread_local Arena threadArena;
+	inline thread_local Arena* active = nullptr;
+
+	// Allocations in the lifetime of a Scope come from the thread's arena, which is reset at the end
+	class Scope {
+
+	public:
+		explicit Scope(bool enabled = true) {
+			if (enabled && active == nullptr) {
+				active = &threadArena;
+				owner = true;
+			}
+		}
+
+		~Scope() {
+			if (owner) {
+				active->reset();
+				active = nullptr;
+			}
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		bool owner = false;
+	};
+
+	inline void* allocate(size_t size) {
+		Header* header = active != nullptr ? active->allocate(sizeof(Header) + size) : (Header*)std::malloc(sizeof(Header) + size);
+		if (header == nullptr)
+			return nullptr;
+		header->size = size;
+		header->owner = active != nullptr ? 1 : 0;
+		return header + 1;
+	}
+
+	inline void release(void* pointer) {
+		if (pointer == nullptr)
+			return;
+		Header* header = (Header*)pointer - 1;
+		if (header->owner == 0)
+			std::free(header);
+		else if (active != nullptr)
+			active->release(header);
+	}
+
+	inline void* reallocate(void* pointer, size_t size) {
+		if (pointer == nullptr)
+			return allocate(size);
+		Header* header = (Header*)pointer - 1;
+		if (header->owner == 0) {
+			header = (Header*)std::realloc(header, sizeof(Header) + size);
+			if (header == nullptr)
+				return nullptr;
+			header->size = size;
+			return header + 1;
+		}
+		if (active != nullptr && active->grow(header, sizeof(Header) + size)) {
+			header->size = size;
+			return pointer;
+		}
+		void* moved = allocate(size);
+		if (moved != nullptr) {
+			std::memcpy(moved, pointer, std::min(header->size, size));
+			release(pointer);
+		}
+		return moved;
+	}
+}
+
+#endif
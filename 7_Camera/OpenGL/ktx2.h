@@ -0,0 +1,304 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+
+/*
+	The parts of the KTX 2.0 container (Khronos texture file) used by the
+	texture cooker and the loader, no OpenGL here so the tools can use it.
+
+	File layout:
+		header (80 bytes)
+		level index, one {offset, length, uncompressed length} per mip level
+		data format descriptor (what the texel bits mean)
+		key/value data (e.g. the image orientation)
+		mip levels, smallest first, each one ready to hand to OpenGL
+
+	Only what the lessons need is supported: single 2D images (no arrays,
+	cubemaps or 3D), no supercompression, and the formats below.
+*/
+namespace Ktx2 {
+
+	const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	// KTX2 stores Vulkan format numbers
+	enum Format : uint32_t {
+		FORMAT_UNDEFINED = 0,
+		FORMAT_R8G8B8A8_UNORM = 37,
+		FORMAT_R8G8B8A8_SRGB = 43,
+		FORMAT_BC1_RGBA_UNORM = 133,
+		FORMAT_BC1_RGBA_SRGB = 134,
+		FORMAT_BC3_UNORM = 137,
+		FORMAT_BC3_SRGB = 138,
+		FORMAT_BC7_UNORM = 145,
+		FORMAT_BC7_SRGB = 146
+	};
+
+	struct Header {
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+	static_assert(sizeof(Header) == 80, "KTX2 header must be 80 bytes");
+
+	struct LevelIndex {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	inline bool isCompressed(uint32_t format) {
+		return format >= FORMAT_BC1_RGBA_UNORM && format <= FORMAT_BC7_SRGB;
+	}
+
+	inline bool isSrgb(uint32_t format) {
+		return format == FORMAT_R8G8B8A8_SRGB || format == FORMAT_BC1_RGBA_SRGB || format == FORMAT_BC3_SRGB || format == FORMAT_BC7_SRGB;
+	}
+
+	inline bool isSupported(uint32_t format) {
+		switch (format) {
+		case FORMAT_R8G8B8A8_UNORM: case FORMAT_R8G8B8A8_SRGB:
+		case FORMAT_BC1_RGBA_UNORM: case FORMAT_BC1_RGBA_SRGB:
+		case FORMAT_BC3_UNORM: case FORMAT_BC3_SRGB:
+		case FORMAT_BC7_UNORM: case FORMAT_BC7_SRGB:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Bytes of one 4x4 block, or of one pixel for uncompressed formats
+	inline uint32_t blockBytes(uint32_t format) {
+		if (format == FORMAT_BC1_RGBA_UNORM || format == FORMAT_BC1_RGBA_SRGB)
+			return 8;
+		if (isCompressed(format))
+			return 16;
+		return 4;
+	}
+
+	// Bytes of a mip level, block compressed levels are padded to whole 4x4 blocks
+	inline uint64_t levelSize(uint32_t format, uint32_t width, uint32_t height) {
+		if (isCompressed(format))
+			return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+		return (uint64_t)width * height * blockBytes(format);
+	}
+
+	// Levels of a full mip chain, down to 1x1
+	inline uint32_t mipCount(uint32_t width, uint32_t height) {
+		uint32_t levels = 1;
+		while (width > 1 || height > 1) {
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+			levels++;
+		}
+		return levels;
+	}
+
+	// Values of the Khronos Data Format Specification (khr_df.h) used in the descriptors
+	const uint8_t DF_MODEL_RGBSDA = 1;
+	const uint8_t DF_MODEL_BC1A = 128;
+	const uint8_t DF_MODEL_BC3 = 130;
+	const uint8_t DF_MODEL_BC7 = 134;
+	const uint8_t DF_CHANNEL_RED = 0, DF_CHANNEL_GREEN = 1, DF_CHANNEL_BLUE = 2, DF_CHANNEL_ALPHA = 15;
+	const uint8_t DF_CHANNEL_BC1A_COLOR = 0, DF_CHANNEL_BC1A_ALPHAPRESENT = 1;
+	const uint8_t DF_CHANNEL_BC3_COLOR = 0, DF_CHANNEL_BC3_ALPHA = 15;
+	const uint8_t DF_CHANNEL_BC7_COLOR = 0;
+	const uint8_t DF_TRANSFER_LINEAR = 1, DF_TRANSFER_SRGB = 2;
+	// Qualifier of a sample's channel, set on alpha in sRGB formats (alpha is never sRGB encoded)
+	const uint8_t DF_SAMPLE_LINEAR = 0x10;
+
+	/*
+		Data format descriptor, required by the spec so other tools can read
+		the file: a single "basic" block describing the color model and the
+		bits of each channel (sample) of a pixel or compressed block.
+	*/
+	inline std::vector<uint8_t> formatDescriptor(uint32_t format) {
+		struct Sample { uint16_t bitOffset; uint8_t bitLength; uint8_t channel; };
+		std::vector<Sample> samples;
+		uint8_t colorModel, blockDimension;
+		uint8_t linearAlpha = isSrgb(format) ? DF_SAMPLE_LINEAR : 0x00;
+
+		switch (format) {
+		case FORMAT_BC1_RGBA_UNORM: case FORMAT_BC1_RGBA_SRGB:
+			// The encoder uses punch-through alpha, so the block says alpha is present
+			colorModel = DF_MODEL_BC1A; blockDimension = 3;
+			samples = { { 0, 63, DF_CHANNEL_BC1A_ALPHAPRESENT } };
+			break;
+		case FORMAT_BC3_UNORM: case FORMAT_BC3_SRGB:
+			colorModel = DF_MODEL_BC3; blockDimension = 3;
+			samples = { { 0, 63, (uint8_t)(DF_CHANNEL_BC3_ALPHA | linearAlpha) }, { 64, 63, DF_CHANNEL_BC3_COLOR } };
+			break;
+		case FORMAT_BC7_UNORM: case FORMAT_BC7_SRGB:
+			colorModel = DF_MODEL_BC7; blockDimension = 3;
+			samples = { { 0, 127, DF_CHANNEL_BC7_COLOR } };
+			break;
+		default:
+			// 8 bits per channel
+			colorModel = DF_MODEL_RGBSDA; blockDimension = 0;
+			samples = { { 0, 7, DF_CHANNEL_RED }, { 8, 7, DF_CHANNEL_GREEN }, { 16, 7, DF_CHANNEL_BLUE },
+				{ 24, 7, (uint8_t)(DF_CHANNEL_ALPHA | linearAlpha) } };
+			break;
+		}
+
+		uint32_t blockSize = 24 + 16 * (uint32_t)samples.size();
+		std::vector<uint8_t> dfd(4 + blockSize, 0);
+		auto put32 = [&dfd](size_t offset, uint32_t value) { std::memcpy(&dfd[offset], &value, 4); };
+
+		put32(0, (uint32_t)dfd.size());			// dfdTotalSize
+		put32(4, 0);							// vendorId 0 (Khronos), descriptorType 0 (basic)
+		put32(8, 2 | (blockSize << 16));		// versionNumber 2, descriptorBlockSize
+		dfd[12] = colorModel;
+		dfd[13] = 1;							// BT.709 primaries
+		dfd[14] = isSrgb(format) ? DF_TRANSFER_SRGB : DF_TRANSFER_LINEAR;
+		dfd[15] = 0;							// straight alpha
+		dfd[16] = blockDimension;				// block width - 1
+		dfd[17] = blockDimension;				// block height - 1
+		dfd[20] = (uint8_t)blockBytes(format);	// bytesPlane0
+
+		for (size_t i = 0; i < samples.size(); i++) {
+			size_t offset = 28 + 16 * i;
+			put32(offset, samples[i].bitOffset | (samples[i].bitLength << 16) | ((uint32_t)samples[i].channel << 24));
+			// sampleLower and sampleUpper, the whole range of the bits
+			put32(offset + 8, 0);
+			put32(offset + 12, isCompressed(format) ? 0xFFFFFFFFu : 255u);
+		}
+		return dfd;
+	}
+
+	/*
+		Reads a data format descriptor back and returns the format it describes,
+		FORMAT_UNDEFINED if it isn't exactly one of the supported formats as the
+		spec lays them out. formatDescriptor(format) must give back format.
+	*/
+	inline uint32_t describedFormat(const uint8_t* dfd, size_t size) {
+		auto get32 = [dfd](size_t offset) { uint32_t value; std::memcpy(&value, dfd + offset, 4); return value; };
+		if (size < 28 || get32(0) != size || get32(4) != 0 || (get32(8) & 0xFFFF) != 2)
+			return FORMAT_UNDEFINED;
+		uint32_t blockSize = get32(8) >> 16;
+		if (4 + blockSize != size || blockSize < 24 || (blockSize - 24) % 16 != 0)
+			return FORMAT_UNDEFINED;
+
+		struct Sample { uint32_t bitOffset, bitLength; uint8_t channel, qualifiers; };
+		std::vector<Sample> samples((blockSize - 24) / 16);
+		for (size_t i = 0; i < samples.size(); i++) {
+			uint32_t word = get32(28 + 16 * i);
+			samples[i] = { word & 0xFFFF, ((word >> 16) & 0xFF) + 1, (uint8_t)((word >> 24) & 0x0F), (uint8_t)((word >> 24) & 0xF0) };
+		}
+
+		bool srgb = dfd[14] == DF_TRANSFER_SRGB;
+		if (!srgb && dfd[14] != DF_TRANSFER_LINEAR)
+			return FORMAT_UNDEFINED;
+		uint8_t alphaQualifier = srgb ? DF_SAMPLE_LINEAR : 0;
+		auto is = [&samples](size_t i, uint32_t bitOffset, uint32_t bitLength, uint8_t channel, uint8_t qualifiers) {
+			return samples[i].bitOffset == bitOffset && samples[i].bitLength == bitLength
+				&& samples[i].channel == channel && samples[i].qualifiers == qualifiers;
+		};
+		bool block4x4 = dfd[16] == 3 && dfd[17] == 3;
+
+		switch (dfd[12]) {
+		case DF_MODEL_RGBSDA:
+			if (dfd[16] == 0 && dfd[17] == 0 && dfd[20] == 4 && samples.size() == 4 && is(0, 0, 8, DF_CHANNEL_RED, 0)
+				&& is(1, 8, 8, DF_CHANNEL_GREEN, 0) && is(2, 16, 8, DF_CHANNEL_BLUE, 0) && is(3, 24, 8, DF_CHANNEL_ALPHA, alphaQualifier))
+				return srgb ? FORMAT_R8G8B8A8_SRGB : FORMAT_R8G8B8A8_UNORM;
+			break;
+		case DF_MODEL_BC1A:
+			if (block4x4 && dfd[20] == 8 && samples.size() == 1 && is(0, 0, 64, DF_CHANNEL_BC1A_ALPHAPRESENT, 0))
+				return srgb ? FORMAT_BC1_RGBA_SRGB : FORMAT_BC1_RGBA_UNORM;
+			break;
+		case DF_MODEL_BC3:
+			if (block4x4 && dfd[20] == 16 && samples.size() == 2 && is(0, 0, 64, DF_CHANNEL_BC3_ALPHA, alphaQualifier)
+				&& is(1, 64, 64, DF_CHANNEL_BC3_COLOR, 0))
+				return srgb ? FORMAT_BC3_SRGB : FORMAT_BC3_UNORM;
+			break;
+		case DF_MODEL_BC7:
+			if (block4x4 && dfd[20] == 16 && samples.size() == 1 && is(0, 0, 128, DF_CHANNEL_BC7_COLOR, 0))
+				return srgb ? FORMAT_BC7_SRGB : FORMAT_BC7_UNORM;
+			break;
+		}
+		return FORMAT_UNDEFINED;
+	}
+
+	inline uint32_t describedFormat(const std::vector<uint8_t>& dfd) {
+		return describedFormat(dfd.data(), dfd.size());
+	}
+
+	/*
+		Writes a 2D texture. levels[0] is the full size image, each next one
+		half the size, already in the layout of the format. flippedRows tells
+		readers the first row is the bottom one, as OpenGL expects.
+	*/
+	inline bool write(const std::string& path, uint32_t format, uint32_t width, uint32_t height,
+		const std::vector<std::vector<uint8_t>>& levels, bool flippedRows) {
+		if (levels.empty() || !isSupported(format))
+			return false;
+
+		std::vector<uint8_t> dfd = formatDescriptor(format);
+
+		// Key/value data: length, "key\0value\0", padded to 4 bytes
+		std::string orientation = std::string("KTXorientation") + '\0' + (flippedRows ? "ru" : "rd") + '\0';
+		std::vector<uint8_t> kvd(4 + orientation.size());
+		uint32_t pairLength = (uint32_t)orientation.size();
+		std::memcpy(kvd.data(), &pairLength, 4);
+		std::memcpy(kvd.data() + 4, orientation.data(), orientation.size());
+		while (kvd.size() % 4 != 0)
+			kvd.push_back(0);
+
+		Header header = {};
+		std::memcpy(header.identifier, identifier, sizeof(identifier));
+		header.vkFormat = format;
+		header.typeSize = 1;
+		header.pixelWidth = width;
+		header.pixelHeight = height;
+		header.faceCount = 1;
+		header.levelCount = (uint32_t)levels.size();
+		header.dfdByteOffset = (uint32_t)(sizeof(Header) + sizeof(LevelIndex) * levels.size());
+		header.dfdByteLength = (uint32_t)dfd.size();
+		header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+		header.kvdByteLength = (uint32_t)kvd.size();
+
+		// Smallest level first, each one aligned to 16 bytes (a multiple of every block size)
+		std::vector<LevelIndex> index(levels.size());
+		uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+		for (size_t i = levels.size(); i-- > 0;) {
+			offset = (offset + 15) & ~(uint64_t)15;
+			index[i] = { offset, levels[i].size(), levels[i].size() };
+			offset += levels[i].size();
+		}
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)index.data(), sizeof(LevelIndex) * index.size());
+		file.write((const char*)dfd.data(), dfd.size());
+		file.write((const char*)kvd.data(), kvd.size());
+
+		uint64_t written = header.kvdByteOffset + header.kvdByteLength;
+		const char padding[16] = {};
+		for (size_t i = levels.size(); i-- > 0;) {
+			file.write(padding, index[i].byteOffset - written);
+			file.write((const char*)levels[i].data(), levels[i].size());
+			written = index[i].byteOffset + levels[i].size();
+		}
+		return (bool)file;
+	}
+}
+
+#endif
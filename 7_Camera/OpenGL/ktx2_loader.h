@@ -0,0 +1,172 @@
+#ifndef KTX2_LOADER_H
+#define KTX2_LOADER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <cstring>
+#include <iostream>
+
+#include "ktx2.h"
+#include "mapped_file.h"
+#include "gl_state.h"
+#include "gl_extensions.h"
+
+// S3TC (BC1/BC3) isn't core OpenGL and glad was generated without extensions
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+/*
+	Texture cooked offline by Tools/TextureCooker into a .ktx2 file.
+
+	The file already holds every mip level in the format OpenGL wants
+	(RGBA8 or BC1/BC3/BC7 blocks), so loading is mapping the file and one
+	glCompressedTexSubImage2D (or glTexSubImage2D) per level straight from
+	the mapped pages: no image decoding and no glGenerateMipmap.
+
+	open() only touches the file, so it can run on a worker thread,
+	upload() must run on the GL thread. A texture in a mounted asset pack
+	is opened from its span instead, the levels are read from the pack's
+	mapping the same way.
+*/
+class Ktx2Texture {
+
+public:
+	uint32_t format = Ktx2::FORMAT_UNDEFINED;
+	uint32_t width = 0, height = 0;
+	uint32_t levelCount = 0;
+
+	bool open(const std::string& path) {
+		if (!file.open(path)) {
+			std::cout << "ERROR::KTX2::FILE_NOT_SUCCESFULLY_READ\n" << path << std::endl;
+			return false;
+		}
+		return parse(file.data(), file.size(), path);
+	}
+
+	// data must stay valid until the texture is uploaded, name is only for errors
+	bool open(const unsigned char* data, size_t size, const std::string& name) {
+		file.close();
+		return parse(data, size, name);
+	}
+
+	uint32_t levelWidth(uint32_t level) const {
+		return width >> level > 0 ? width >> level : 1;
+	}
+
+	uint32_t levelHeight(uint32_t level) const {
+		return height >> level > 0 ? height >> level : 1;
+	}
+
+	static GLenum internalFormat(uint32_t format) {
+		switch (format) {
+		case Ktx2::FORMAT_R8G8B8A8_UNORM: return GL_RGBA8;
+		case Ktx2::FORMAT_R8G8B8A8_SRGB: return GL_SRGB8_ALPHA8;
+		case Ktx2::FORMAT_BC1_RGBA_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case Ktx2::FORMAT_BC1_RGBA_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+		case Ktx2::FORMAT_BC3_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case Ktx2::FORMAT_BC3_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+		case Ktx2::FORMAT_BC7_UNORM: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		case Ktx2::FORMAT_BC7_SRGB: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+		default: return 0;
+		}
+	}
+
+	// BC7 (BPTC) is core since 4.2, BC1/BC3 need the S3TC extension
+	static bool driverSupports(uint32_t format) {
+		if (!Ktx2::isCompressed(format) || format >= Ktx2::FORMAT_BC7_UNORM)
+			return true;
+		return hasGLExtension("GL_EXT_texture_compression_s3tc");
+	}
+
+	// Creates the texture from the mapped file, returns 0 if the driver can't use the format
+	unsigned int upload() const {
+		if (bytes == nullptr)
+			return 0;
+		if (!driverSupports(format)) {
+			std::cout << "ERROR::KTX2::FORMAT_NOT_SUPPORTED_BY_DRIVER\n" << format << std::endl;
+			return 0;
+		}
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		GLState::bindTexture(0, GL_TEXTURE_2D, texture);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		// Every level is allocated at once, then filled from the file
+		glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat(format), width, height);
+		for (uint32_t level = 0; level < levelCount; level++) {
+			const unsigned char* data = bytes + levels[level].byteOffset;
+			if (Ktx2::isCompressed(format))
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, levelWidth(level), levelHeight(level),
+					internalFormat(format), (GLsizei)levels[level].byteLength, data);
+			else
+				glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, levelWidth(level), levelHeight(level), GL_RGBA, GL_UNSIGNED_BYTE, data);
+		}
+		return texture;
+	}
+
+private:
+	// Mapping of the file, unused when opened from memory
+	MappedFile file;
+	const unsigned char* bytes = nullptr;
+	const Ktx2::LevelIndex* levels = nullptr;
+
+	bool parse(const unsigned char* data, size_t size, const std::string& path) {
+		Ktx2::Header header;
+		if (size < sizeof(header))
+			return fail(path, "TRUNCATED");
+		std::memcpy(&header, data, sizeof(header));
+
+		if (std::memcmp(header.identifier, Ktx2::identifier, sizeof(Ktx2::identifier)) != 0)
+			return fail(path, "NOT_A_KTX2_FILE");
+		if (!Ktx2::isSupported(header.vkFormat))
+			return fail(path, "UNSUPPORTED_FORMAT");
+		if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.supercompressionScheme != 0)
+			return fail(path, "ONLY_2D_UNCOMPRESSED_CONTAINERS");
+
+		format = header.vkFormat;
+		width = header.pixelWidth;
+		height = header.pixelHeight;
+		// 0 levels means "generate them at load", which is what this avoids
+		levelCount = header.levelCount;
+		if (levelCount == 0 || levelCount > Ktx2::mipCount(width, height))
+			return fail(path, "BAD_LEVEL_COUNT");
+
+		size_t indexEnd = sizeof(header) + sizeof(Ktx2::LevelIndex) * levelCount;
+		if (size < indexEnd)
+			return fail(path, "TRUNCATED");
+		bytes = data;
+		levels = (const Ktx2::LevelIndex*)(data + sizeof(header));
+
+		for (uint32_t level = 0; level < levelCount; level++) {
+			uint64_t expected = Ktx2::levelSize(format, levelWidth(level), levelHeight(level));
+			if (levels[level].byteLength != expected || levels[level].byteOffset + levels[level].byteLength > size)
+				return fail(path, "BAD_LEVEL");
+			// Start reading the pages in now, so upload() doesn't wait on page faults
+			if (file.isOpen())
+				file.prefetch((size_t)levels[level].byteOffset, (size_t)levels[level].byteLength);
+		}
+		return true;
+	}
+
+	bool fail(const std::string& path, const char* reason) {
+		std::cout << "ERROR::KTX2::" << reason << "\n" << path << std::endl;
+		file.close();
+		bytes = nullptr;
+		levels = nullptr;
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+	Read-only memory mapping of a whole file.
+
+	Instead of reading the file into a buffer, its pages are mapped into
+	the address space and loaded by the OS the first time they are touched,
+	so opening a big file costs almost nothing and its bytes can be handed
+	to OpenGL (or anything else) without copying them first.
+*/
+class MappedFile {
+
+public:
+	MappedFile() {}
+
+	explicit MappedFile(const std::string& path) {
+		open(path);
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		length = (size_t)fileSize.QuadPart;
+#else
+		int descriptor = ::open(path.c_str(), O_RDONLY);
+		if (descriptor < 0)
+			return false;
+		struct stat info;
+		if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+			::close(descriptor);
+			return false;
+		}
+		void* address = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		// The mapping keeps its own reference to the file
+		::close(descriptor);
+		if (address == MAP_FAILED)
+			return false;
+		bytes = (const unsigned char*)address;
+		length = (size_t)info.st_size;
+#endif
+		if (bytes == nullptr) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+#ifdef _WIN32
+		if (bytes != nullptr)
+			UnmapViewOfFile(bytes);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes != nullptr)
+			munmap((void*)bytes, length);
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+
+	bool isOpen() const {
+		return bytes != nullptr;
+	}
+
+	const unsigned char* data() const {
+		return bytes;
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+	/*
+		Tells the OS the range will be read soon, so its pages are read
+		ahead instead of one page fault at a time. Only a hint.
+	*/
+	void prefetch(size_t offset, size_t count) const {
+		if (bytes == nullptr || offset >= length)
+			return;
+		if (count > length - offset)
+			count = length - offset;
+#ifdef _WIN32
+		WIN32_MEMORY_RANGE_ENTRY range = { (PVOID)(bytes + offset), count };
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+		// madvise wants a page aligned address
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t start = offset & ~(page - 1);
+		madvise((void*)(bytes + start), count + (offset - start), MADV_WILLNEED);
+#endif
+	}
+
+private:
+	const unsigned char* bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+
+#endif
@@ -0,0 +1,34 @@
+// Material table, filled by MaterialTable (material_table.h), same std430 layout as MaterialData
+struct MaterialTexture
+{
+	uvec2 handle;	// bindless handle of the texture array
+	uint array;		// unit of the texture array, without bindless
+	float layer;
+	vec4 uvRect;	// UV offset (xy) and scale (zw) inside the layer
+};
+
+struct Material
+{
+	MaterialTexture textures[2];
+};
+
+layout (std430, binding = 0) readonly buffer MaterialTable
+{
+	Material materials[];
+};
+
+#ifndef BINDLESS
+// Every texture array the materials use, bound to units 0 to 7
+layout (binding = 0) uniform sampler2DArray textureArrays[8];
+#endif
+
+// The material index is the same for the whole draw, so indexing textureArrays with it is allowed
+vec4 sampleMaterial(MaterialTexture materialTexture, vec2 uv)
+{
+	vec3 coords = vec3(materialTexture.uvRect.xy + uv * materialTexture.uvRect.zw, materialTexture.layer);
+#ifdef BINDLESS
+	return texture(sampler2DArray(materialTexture.handle), coords);
+#else
+	return texture(textureArrays[materialTexture.array], coords);
+#endif
+}
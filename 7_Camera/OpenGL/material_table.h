@@ -0,0 +1,180 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <iostream>
+
+#include "texture_packer.h"
+#include "shader_preprocessor.h"
+#include "gl_state.h"
+#include "gl_extensions.h"
+
+// Shader storage buffer binding point of the material table
+#define MATERIAL_TABLE_BINDING 0
+// Textures per material, texture1 and texture2 of the lessons
+#define MATERIAL_TEXTURES 2
+// Texture arrays the fallback can bind at once, units 0 to 7 (textureArrays[] in the GLSL)
+#define MATERIAL_MAX_ARRAYS 8
+
+// GL_ARB_bindless_texture isn't core and glad was generated without extensions
+typedef uint64_t(APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(uint64_t handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(uint64_t handle);
+
+/*
+	Where to find one texture of a material. The GLSL side is
+	material_table.glsl, it must keep the same std430 layout (32 bytes).
+*/
+struct MaterialTexture {
+	// Bindless handle of the texture array, 0 without bindless
+	uint64_t handle = 0;
+	// Unit of the texture array in the fallback, unused with bindless
+	uint32_t array = 0;
+	float layer = 0.0f;
+	// UV offset (xy) and scale (zw) inside the layer (TextureSlot::uvRect)
+	glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+static_assert(sizeof(MaterialTexture) == 32, "MaterialTexture must match the std430 layout");
+
+struct MaterialData {
+	MaterialTexture textures[MATERIAL_TEXTURES];
+};
+
+/*
+	Every material of the scene in one shader storage buffer, so a draw
+	only says which material it uses (an index, one uniform) and the
+	shader looks its textures up in the table.
+
+	With GL_ARB_bindless_texture the table holds 64 bit handles of the
+	texture arrays, made resident once, and the shader turns them into
+	samplers: nothing is ever bound to a texture unit.
+
+	Without it (e.g. llvmpipe) every array the materials use is bound
+	to its own unit once per frame, and the table holds the unit instead.
+	Either way the draw loop only sets the material index; the shaders
+	must be built with defines() so they read the table the same way.
+*/
+class MaterialTable {
+
+public:
+	// Shader storage buffer object ID
+	unsigned int SSBO = 0;
+	bool bindless = false;
+
+	// loadProc is the same function given to gladLoadGLLoader, e.g. glfwGetProcAddress
+	explicit MaterialTable(GLADloadproc loadProc) {
+		if (hasGLExtension("GL_ARB_bindless_texture")) {
+			getTextureHandle = (PFNGLGETTEXTUREHANDLEARBPROC)loadProc("glGetTextureHandleARB");
+			makeResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)loadProc("glMakeTextureHandleResidentARB");
+			makeNonResident = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)loadProc("glMakeTextureHandleNonResidentARB");
+			bindless = getTextureHandle != NULL && makeResident != NULL && makeNonResident != NULL;
+		}
+		glGenBuffers(1, &SSBO);
+	}
+
+	MaterialTable(const MaterialTable&) = delete;
+	MaterialTable& operator=(const MaterialTable&) = delete;
+
+	// Defines the shaders reading the table need
+	ShaderDefines defines() const {
+		ShaderDefines result;
+		if (bindless)
+			result["BINDLESS"] = "";
+		return result;
+	}
+
+	// Adds a material from packed textures, returns the index to draw it with
+	unsigned int add(const TextureSlot& texture1, const TextureSlot& texture2) {
+		MaterialData material;
+		const TextureSlot* slots[MATERIAL_TEXTURES] = { &texture1, &texture2 };
+		for (int i = 0; i < MATERIAL_TEXTURES; i++) {
+			MaterialTexture& texture = material.textures[i];
+			texture.layer = (float)slots[i]->layer;
+			texture.uvRect = slots[i]->uvRect;
+			if (bindless)
+				texture.handle = residentHandle(slots[i]->array);
+			else
+				texture.array = unitOf(slots[i]->array);
+		}
+		materials.push_back(material);
+		dirty = true;
+		return (unsigned int)materials.size() - 1;
+	}
+
+	size_t count() const {
+		return materials.size();
+	}
+
+	/*
+		Call once per frame before drawing: uploads the table if materials
+		were added, and in the fallback binds the arrays (GLState skips it
+		when they're still bound).
+	*/
+	void bind() {
+		if (dirty) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(MaterialData), materials.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_TABLE_BINDING, SSBO);
+			dirty = false;
+		}
+		for (size_t unit = 0; unit < arrays.size(); unit++)
+			GLState::bindTexture((unsigned int)unit, GL_TEXTURE_2D_ARRAY, arrays[unit]);
+	}
+
+	// Call before the texture arrays are deleted
+	void destroy() {
+		for (auto& resident : handles)
+			makeNonResident(resident.second);
+		handles.clear();
+		arrays.clear();
+		materials.clear();
+		glDeleteBuffers(1, &SSBO);
+		SSBO = 0;
+	}
+
+private:
+	std::vector<MaterialData> materials;
+	bool dirty = false;
+	// Fallback: the array bound to each unit
+	std::vector<unsigned int> arrays;
+	// Bindless: the resident handle of each array
+	std::map<unsigned int, uint64_t> handles;
+
+	PFNGLGETTEXTUREHANDLEARBPROC getTextureHandle = NULL;
+	PFNGLMAKETEXTUREHANDLERESIDENTARBPROC makeResident = NULL;
+	PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC makeNonResident = NULL;
+
+	// Made resident once, a handle stays valid (and its sampling state fixed) until the texture is deleted
+	uint64_t residentHandle(unsigned int array) {
+		if (array == 0)
+			return 0;
+		auto found = handles.find(array);
+		if (found != handles.end())
+			return found->second;
+		uint64_t handle = getTextureHandle(array);
+		makeResident(handle);
+		handles[array] = handle;
+		return handle;
+	}
+
+	uint32_t unitOf(unsigned int array) {
+		for (size_t unit = 0; unit < arrays.size(); unit++) {
+			if (arrays[unit] == array)
+				return (uint32_t)unit;
+		}
+		if (arrays.size() == MATERIAL_MAX_ARRAYS) {
+			std::cout << "ERROR::MATERIAL_TABLE::TOO_MANY_TEXTURE_ARRAYS\n" << MATERIAL_MAX_ARRAYS << " can be bound" << std::endl;
+			return 0;
+		}
+		arrays.push_back(array);
+		return (uint32_t)arrays.size() - 1;
+	}
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef MESH_BUILDER_H
+#define MESH_BUILDER_H
+
+// glm/gtx/hash.hpp is an experimental extension
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include "mesh_optimizer.h"
+
+#include <vector>
+#include <unordered_set>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+/*
+	Vertex and index buffers of a mesh made by MeshBuilder. No OpenGL here
+	so the tools can use it: indexSize says which type to draw with,
+	2 for GL_UNSIGNED_SHORT and 4 for GL_UNSIGNED_INT.
+*/
+struct IndexedMesh {
+	// Interleaved, floatsPerVertex floats per vertex
+	std::vector<float> vertices;
+	int floatsPerVertex = 0;
+	// Only the one matching indexSize is filled
+	std::vector<uint16_t> indices16;
+	std::vector<uint32_t> indices32;
+	unsigned int indexSize = 2;
+
+	size_t vertexCount() const {
+		return floatsPerVertex > 0 ? vertices.size() / floatsPerVertex : 0;
+	}
+
+	size_t indexCount() const {
+		return indexSize == 2 ? indices16.size() : indices32.size();
+	}
+
+	const void* indexData() const {
+		return indexSize == 2 ? (const void*)indices16.data() : (const void*)indices32.data();
+	}
+
+	size_t indexBytes() const {
+		return indexCount() * indexSize;
+	}
+
+	size_t vertexBytes() const {
+		return vertices.size() * sizeof(float);
+	}
+};
+
+/*
+	Turns triangle lists into an indexed mesh.
+
+	A vertex is every attribute together (position, texture coords...),
+	interleaved like the lessons' float arrays. Every vertex added is
+	hashed (glm's std::hash of its attributes) and looked up among the
+	ones already kept, so a vertex repeated by several triangles, like the
+	corners shared by the two triangles of a cube face, is stored once and
+	the triangles point to it with an index instead. Fewer vertices means
+	less memory and fewer vertex shader runs, since the GPU reuses the
+	output of an index it has just transformed.
+
+	Only exact copies are welded: two vertices with the same position but
+	different texture coordinates (or normals) stay apart.
+
+	build() is the cooking step: unless optimize is turned off, the
+	triangles and vertices are reordered by MeshOptimizer for the vertex
+	cache, overdraw and vertex fetch, and report says how much it helped.
+	positionOffset is where the position is in a vertex (the first 3
+	floats in the lessons).
+
+	Indices are 16 bit when the mesh has at most 65536 vertices, 32 bit
+	otherwise.
+*/
+class MeshBuilder {
+
+public:
+	bool optimize = true;
+	int positionOffset = 0;
+	// ACMR/ATVR before and after the optimization, of the last build()
+	MeshOptimizer::Report report;
+
+	explicit MeshBuilder(int floatsPerVertex) : floatsPerVertex(floatsPerVertex),
+		welded(64, VertexHash{ &vertices, floatsPerVertex }, VertexEqual{ &vertices, floatsPerVertex }) {
+	}
+
+	MeshBuilder(const MeshBuilder&) = delete;
+	MeshBuilder& operator=(const MeshBuilder&) = delete;
+
+	// Adds a vertex, returns its index: the one it already had if the same vertex was added before
+	uint32_t addVertex(const float* vertex) {
+		inputVertices++;
+		// Appended first so the set can hash and compare it like the others, taken back if it's a copy
+		uint32_t index = (uint32_t)(vertices.size() / floatsPerVertex);
+		vertices.insert(vertices.end(), vertex, vertex + floatsPerVertex);
+		auto inserted = welded.insert(index);
+		if (!inserted.second) {
+			vertices.resize(vertices.size() - floatsPerVertex);
+			return *inserted.first;
+		}
+		return index;
+	}
+
+	// Non indexed triangle list (every 3 vertices are a triangle), like the cube of the lessons
+	void addTriangles(const float* triangleVertices, size_t vertexCount) {
+		for (size_t i = 0; i < vertexCount; i++)
+			indices.push_back(addVertex(triangleVertices + i * floatsPerVertex));
+	}
+
+	// Already indexed triangles (e.g. an imported mesh), their duplicated vertices are welded too
+	void addIndexedTriangles(const float* meshVertices, size_t vertexCount, const uint32_t* meshIndices, size_t indexCount) {
+		std::vector<uint32_t> remap(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+			remap[i] = addVertex(meshVertices + i * floatsPerVertex);
+		for (size_t i = 0; i < indexCount; i++)
+			indices.push_back(remap[meshIndices[i]]);
+	}
+
+	// Vertices given so far, before welding
+	size_t inputVertexCount() const {
+		return inputVertices;
+	}
+
+	IndexedMesh build() {
+		IndexedMesh mesh;
+		mesh.vertices = vertices;
+		mesh.floatsPerVertex = floatsPerVertex;
+		std::vector<uint32_t> cooked = indices;
+		if (optimize)
+			report = MeshOptimizer::optimize(cooked, mesh.vertices, floatsPerVertex, positionOffset);
+		else
+			report.before = report.after = MeshOptimizer::analyze(cooked, mesh.vertexCount());
+		if (mesh.vertexCount() <= 65536) {
+			mesh.indexSize = 2;
+			mesh.indices16.assign(cooked.begin(), cooked.end());
+		}
+		else {
+			mesh.indexSize = 4;
+			mesh.indices32 = cooked;
+		}
+		return mesh;
+	}
+
+private:
+	// The set only holds indices, the vertices themselves are read from the builder's array
+	struct VertexHash {
+		const std::vector<float>* vertices;
+		int floatsPerVertex;
+
+		size_t operator()(uint32_t index) const {
+			const float* vertex = vertices->data() + (size_t)index * floatsPerVertex;
+			size_t seed = 0;
+			int i = 0;
+			for (; i + 4 <= floatsPerVertex; i += 4)
+				combine(seed, std::hash<glm::vec4>()(glm::make_vec4(vertex + i)));
+			switch (floatsPerVertex - i) {
+			case 3: combine(seed, std::hash<glm::vec3>()(glm::make_vec3(vertex + i))); break;
+			case 2: combine(seed, std::hash<glm::vec2>()(glm::make_vec2(vertex + i))); break;
+			case 1: combine(seed, std::hash<float>()(vertex[i])); break;
+			}
+			return seed;
+		}
+
+		// Same mix as glm's hash_combine
+		static void combine(size_t& seed, size_t hash) {
+			seed ^= hash + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		}
+	};
+
+	struct VertexEqual {
+		const std::vector<float>* vertices;
+		int floatsPerVertex;
+
+		bool operator()(uint32_t a, uint32_t b) const {
+			const float* first = vertices->data() + (size_t)a * floatsPerVertex;
+			const float* second = vertices->data() + (size_t)b * floatsPerVertex;
+			for (int i = 0; i < floatsPerVertex; i++) {
+				if (first[i] != second[i])
+					return false;
+			}
+			return true;
+		}
+	};
+
+	int floatsPerVertex;
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	std::unordered_set<uint32_t, VertexHash, VertexEqual> welded;
+	size_t inputVertices = 0;
+};
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+/*
+	Reorders the triangles and vertices of an indexed mesh so the GPU does
+	less work drawing it. Nothing drawn changes, only the order.
+
+	After a vertex is transformed the GPU keeps the result in a small
+	cache for a few more vertices, so a triangle reusing vertices of the
+	last few triangles gets them for free. The number of vertices
+	transformed per triangle (ACMR) goes from 3 in the worst order down to
+	about 0.5 on a regular grid, and per vertex of the mesh (ATVR) from
+	up to 6 down to 1, the best possible.
+
+	optimize() runs, in order:
+		vertex cache: Tom Forsyth's "Linear-Speed Vertex Cache
+		Optimisation", each next triangle is the best scored one around
+		the vertices in a simulated cache
+		overdraw: the result is cut in clusters that each keep their
+		cache efficiency (within the threshold), which are sorted so the
+		ones facing out from the middle of the mesh come first. They tend
+		to hide the others, so fewer fragments are shaded and thrown away
+		vertex fetch: vertices renumbered in the order the triangles
+		first use them, so the vertex buffer is read front to back
+
+	analyze() simulates a FIFO cache (like the hardware) to give ACMR and
+	ATVR; optimize() returns them before and after.
+*/
+namespace MeshOptimizer {
+
+	// Cache the Forsyth scores are tuned for, and the FIFO analyze() simulates (about what GPUs have)
+	const int optimizeCacheSize = 32;
+	const int analyzeCacheSize = 16;
+
+	struct Statistics {
+		// Vertices transformed per triangle, and per vertex of the mesh
+		float acmr = 0.0f;
+		float atvr = 0.0f;
+	};
+
+	struct Report {
+		Statistics before, after;
+		unsigned int clusters = 0;
+	};
+
+	inline Statistics analyze(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = analyzeCacheSize) {
+		Statistics statistics;
+		if (indices.empty() || vertexCount == 0)
+			return statistics;
+
+		// FIFO: a vertex is in the cache if it was loaded less than cacheSize misses ago
+		std::vector<size_t> loadedAt(vertexCount, 0);
+		size_t misses = 0;
+		for (uint32_t index : indices) {
+			if (loadedAt[index] == 0 || misses - loadedAt[index] >= (size_t)cacheSize) {
+				misses++;
+				loadedAt[index] = misses;
+			}
+		}
+		statistics.acmr = (float)misses / (indices.size() / 3);
+		statistics.atvr = (float)misses / vertexCount;
+		return statistics;
+	}
+
+	namespace Forsyth {
+		const float cacheDecayPower = 1.5f;
+		const float lastTriangleScore = 0.75f;
+		const float valenceBoostScale = 2.0f;
+		const float valenceBoostPower = 0.5f;
+
+		inline float vertexScore(int cachePosition, unsigned int remainingTriangles) {
+			if (remainingTriangles == 0)
+				return -1.0f;
+			float score = 0.0f;
+			if (cachePosition >= 0) {
+				// The 3 vertices of the last triangle get a fixed score, so it isn't reused right away
+				if (cachePosition < 3)
+					score = lastTriangleScore;
+				else
+					score = std::pow(1.0f - (float)(cachePosition - 3) / (optimizeCacheSize - 3), cacheDecayPower);
+			}
+			// Vertices with few triangles left are finished first, so they don't stay behind
+			return score + valenceBoostScale * std::pow((float)remainingTriangles, -valenceBoostPower);
+		}
+	}
+
+	inline std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount) {
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return indices;
+
+		// Triangles of each vertex, in one array
+		std::vector<unsigned int> remaining(vertexCount, 0);
+		for (uint32_t index : indices)
+			remaining[index]++;
+		std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++)
+			firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+		std::vector<uint32_t> triangles(indices.size());
+		std::vector<size_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (int corner = 0; corner < 3; corner++)
+				triangles[filled[indices[t * 3 + corner]]++] = (uint32_t)t;
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScores(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			vertexScores[v] = Forsyth::vertexScore(-1, remaining[v]);
+		std::vector<float> triangleScores(triangleCount);
+		for (size_t t = 0; t < triangleCount; t++)
+			triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+		std::vector<bool> emitted(triangleCount, false);
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+		// One longer than the cache, the vertices pushed out of it still need their score updated
+		std::vector<uint32_t> cache, nextCache;
+		size_t scanCursor = 0;
+		int best = -1;
+
+		for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+			if (best < 0) {
+				// Nothing good around the cache, the next triangle not drawn yet
+				while (emitted[scanCursor])
+					scanCursor++;
+				best = (int)scanCursor;
+			}
+			const uint32_t* corners = &indices[(size_t)best * 3];
+			result.insert(result.end(), corners, corners + 3);
+			emitted[best] = true;
+
+			// Drawn triangle's vertices go to the front of the cache, the others move back
+			nextCache.assign(corners, corners + 3);
+			for (uint32_t vertex : cache) {
+				if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+					nextCache.push_back(vertex);
+			}
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t vertex = corners[corner];
+				uint32_t* list = &triangles[firstTriangle[vertex]];
+				// Take the triangle out of the vertex's list, the remaining ones stay in front
+				for (unsigned int i = 0; i < remaining[vertex]; i++) {
+					if (list[i] == (uint32_t)best) {
+						std::swap(list[i], list[remaining[vertex] - 1]);
+						break;
+					}
+				}
+				remaining[vertex]--;
+			}
+			cache.swap(nextCache);
+
+			// Rescore what moved in the cache, then find the best triangle around it
+			for (size_t position = 0; position < cache.size(); position++) {
+				uint32_t vertex = cache[position];
+				cachePosition[vertex] = position < (size_t)optimizeCacheSize ? (int)position : -1;
+				float score = Forsyth::vertexScore(cachePosition[vertex], remaining[vertex]);
+				float change = score - vertexScores[vertex];
+				vertexScores[vertex] = score;
+				for (unsigned int i = 0; i < remaining[vertex]; i++)
+					triangleScores[triangles[firstTriangle[vertex] + i]] += change;
+			}
+			float bestScore = -1.0f;
+			best = -1;
+			for (size_t position = 0; position < cache.size() && position < (size_t)optimizeCacheSize; position++) {
+				uint32_t vertex = cache[position];
+				for (unsigned int i = 0; i < remaining[vertex]; i++) {
+					uint32_t triangle = triangles[firstTriangle[vertex] + i];
+					if (triangleScores[triangle] > bestScore) {
+						bestScore = triangleScores[triangle];
+						best = (int)triangle;
+					}
+				}
+			}
+			if (cache.size() > (size_t)optimizeCacheSize)
+				cache.resize(optimizeCacheSize);
+		}
+		return result;
+	}
+
+	/*
+		Sorts clusters of triangles front to back from outside the mesh.
+		Cluster boundaries are where the FIFO cache would start from empty
+		anyway (a triangle with all 3 vertices missing), then each of those
+		is cut again as soon as the part so far is within threshold times
+		its cache cost, so the cache order costs at most threshold times
+		more (1.05 = 5%).
+	*/
+	inline std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<float>& vertices,
+		int floatsPerVertex, int positionOffset = 0, float threshold = 1.05f, unsigned int* clusterCount = nullptr) {
+		size_t triangleCount = indices.size() / 3;
+		size_t vertexCount = vertices.size() / floatsPerVertex;
+		if (triangleCount < 2)
+			return indices;
+
+		// Misses of every triangle, in a FIFO cache that starts empty at firstTriangle
+		std::vector<size_t> loadedAt(vertexCount, 0);
+		size_t misses = 0;
+		auto simulate = [&](size_t triangle) {
+			unsigned int triangleMisses = 0;
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t index = indices[triangle * 3 + corner];
+				if (loadedAt[index] == 0 || misses - loadedAt[index] >= (size_t)analyzeCacheSize) {
+					misses++;
+					loadedAt[index] = misses;
+					triangleMisses++;
+				}
+			}
+			return triangleMisses;
+		};
+		auto flush = [&]() {
+			// Far enough back that every vertex counts as gone
+			misses += analyzeCacheSize;
+		};
+
+		std::vector<size_t> hard;
+		for (size_t t = 0; t < triangleCount; t++) {
+			if (simulate(t) == 3)
+				hard.push_back(t);
+		}
+		hard.push_back(triangleCount);
+
+		std::vector<size_t> clusters;
+		for (size_t h = 0; h + 1 < hard.size(); h++) {
+			size_t start = hard[h], end = hard[h + 1];
+			flush();
+			size_t clusterMisses = 0;
+			for (size_t t = start; t < end; t++)
+				clusterMisses += simulate(t);
+			float limit = threshold * clusterMisses / (end - start);
+
+			flush();
+			size_t splitStart = start, splitMisses = 0;
+			clusters.push_back(start);
+			for (size_t t = start; t < end; t++) {
+				splitMisses += simulate(t);
+				if (t + 1 < end && (float)splitMisses / (t + 1 - splitStart) <= limit) {
+					clusters.push_back(t + 1);
+					splitStart = t + 1;
+					splitMisses = 0;
+					flush();
+				}
+			}
+		}
+		clusters.push_back(triangleCount);
+
+		auto position = [&](uint32_t index) {
+			const float* p = &vertices[(size_t)index * floatsPerVertex + positionOffset];
+			return glm::vec3(p[0], p[1], p[2]);
+		};
+		glm::vec3 meshCenter(0.0f);
+		for (size_t v = 0; v < vertexCount; v++)
+			meshCenter += position((uint32_t)v);
+		meshCenter /= (float)vertexCount;
+
+		// How much each cluster faces away from the middle: centroid and normal, weighted by area
+		std::vector<std::pair<float, size_t>> order;
+		for (size_t c = 0; c + 1 < clusters.size(); c++) {
+			glm::vec3 center(0.0f), normal(0.0f);
+			float area = 0.0f;
+			for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+				glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), d = position(indices[t * 3 + 2]);
+				glm::vec3 cross = glm::cross(b - a, d - a);
+				float triangleArea = glm::length(cross);
+				center += (a + b + d) / 3.0f * triangleArea;
+				normal += cross;
+				area += triangleArea;
+			}
+			float facing = 0.0f;
+			if (area > 0.0f && glm::length(normal) > 0.0f)
+				facing = glm::dot(center / area - meshCenter, glm::normalize(normal));
+			order.push_back({ facing, c });
+		}
+		std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+		for (const auto& cluster : order)
+			result.insert(result.end(), indices.begin() + clusters[cluster.second] * 3, indices.begin() + clusters[cluster.second + 1] * 3);
+		if (clusterCount != nullptr)
+			*clusterCount = (unsigned int)order.size();
+		return result;
+	}
+
+	// Renumbers the vertices in the order of first use, indices are rewritten in place
+	inline std::vector<float> optimizeVertexFetch(std::vector<uint32_t>& indices, const std::vector<float>& vertices, int floatsPerVertex) {
+		size_t vertexCount = vertices.size() / floatsPerVertex;
+		const uint32_t unused = 0xFFFFFFFF;
+		std::vector<uint32_t> remap(vertexCount, unused);
+		std::vector<float> result;
+		result.reserve(vertices.size());
+		uint32_t next = 0;
+		for (uint32_t& index : indices) {
+			if (remap[index] == unused) {
+				remap[index] = next++;
+				result.insert(result.end(), vertices.begin() + (size_t)index * floatsPerVertex, vertices.begin() + (size_t)(index + 1) * floatsPerVertex);
+			}
+			index = remap[index];
+		}
+		// Vertices no triangle uses are kept at the end
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (remap[v] == unused)
+				result.insert(result.end(), vertices.begin() + v * floatsPerVertex, vertices.begin() + (v + 1) * floatsPerVertex);
+		}
+		return result;
+	}
+
+	// All three passes, positions are the 3 floats at positionOffset in each vertex
+	inline Report optimize(std::vector<uint32_t>& indices, std::vector<float>& vertices, int floatsPerVertex, int positionOffset = 0,
+		float overdrawThreshold = 1.05f) {
+		Report report;
+		size_t vertexCount = vertices.size() / floatsPerVertex;
+		report.before = analyze(indices, vertexCount);
+		indices = optimizeVertexCache(indices, vertexCount);
+		indices = optimizeOverdraw(indices, vertices, floatsPerVertex, positionOffset, overdrawThreshold, &report.clusters);
+		vertices = optimizeVertexFetch(indices, vertices, floatsPerVertex);
+		report.after = analyze(indices, vertexCount);
+		return report;
+	}
+}
+
+#endif
@@ -0,0 +1,405 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+#include "thread_pool.h"
+#include "cpu_features.h"
+
+/*
+	Builds mip chains on the CPU instead of with glGenerateMipmap.
+
+	glGenerateMipmap costs GPU (or, on llvmpipe, GL thread) time on every
+	upload and its filter is whatever the driver chose. Here every level is
+	filtered from the previous one with a known separable filter:
+		FILTER_BOX: average of 2x2 pixels, the usual glGenerateMipmap result
+		FILTER_KAISER: 8 tap windowed sinc, keeps small levels sharper
+		without the aliasing (moire) a box filter leaves
+
+	Pixels are filtered as 4 floats (RGBA, missing channels are padded),
+	which is one SSE register per pixel and two per AVX register. 8 bit sRGB
+	color is converted to linear light first: averaging the encoded values
+	makes small levels darker than they should be. Alpha is always linear.
+
+	Rows of each level are split over a ThreadPool when one is given.
+*/
+namespace MipGenerator {
+
+	enum Filter { FILTER_BOX, FILTER_KAISER };
+
+	struct Options {
+		Filter filter = FILTER_KAISER;
+		// 8 bit color channels are sRGB encoded
+		bool srgb = false;
+	};
+
+	// Instruction set used by the filters, can be lowered (e.g. to compare speeds)
+	inline CpuFeatures::Simd simd = CpuFeatures::detect();
+
+	inline int levelCount(int width, int height) {
+		int levels = 1;
+		while (width > 1 || height > 1) {
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			levels++;
+		}
+		return levels;
+	}
+
+	// Size of every level after the first, packed one after another
+	inline size_t chainSize(int width, int height, int channels) {
+		size_t size = 0;
+		while (width > 1 || height > 1) {
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			size += (size_t)width * height * channels;
+		}
+		return size;
+	}
+
+	// ---- FILTER KERNELS ---- //
+
+	/*
+		Weights of the source pixels 2x + first ... 2x + first + count - 1
+		that make destination pixel x.
+	*/
+	struct Kernel {
+		int first;
+		int count;
+		float weights[8];
+	};
+
+	// Modified Bessel function of the first kind, order 0 (series)
+	inline double besselI0(double x) {
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 32; k++) {
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	inline Kernel makeKernel(Filter filter) {
+		Kernel kernel = {};
+		if (filter == FILTER_BOX) {
+			kernel.first = 0;
+			kernel.count = 2;
+			kernel.weights[0] = kernel.weights[1] = 0.5f;
+			return kernel;
+		}
+
+		// sinc(d) * kaiser(d / 2) with d the distance in destination pixels
+		const double alpha = 4.0, radius = 2.0, pi = 3.14159265358979323846;
+		kernel.first = -3;
+		kernel.count = 8;
+		double sum = 0.0;
+		double weights[8];
+		for (int k = 0; k < 8; k++) {
+			// Source pixel center minus destination center (2x + 1), in destination pixels
+			double d = (kernel.first + k - 0.5) / 2.0;
+			double sinc = d == 0.0 ? 1.0 : std::sin(pi * d) / (pi * d);
+			double t = d / radius;
+			double window = std::fabs(t) < 1.0 ? besselI0(alpha * std::sqrt(1.0 - t * t)) / besselI0(alpha) : 0.0;
+			weights[k] = sinc * window;
+			sum += weights[k];
+		}
+		for (int k = 0; k < 8; k++)
+			kernel.weights[k] = (float)(weights[k] / sum);
+		return kernel;
+	}
+
+	// ---- SEPARABLE PASSES ---- //
+
+	/*
+		Halves the width of rows [firstRow, lastRow): destination pixel x is
+		the weighted sum of source pixels around 2x, clamped at the edges.
+	*/
+	inline void horizontalScalar(const float* source, int width, float* destination, int halfWidth, const Kernel& kernel, size_t firstRow, size_t lastRow) {
+		for (size_t y = firstRow; y < lastRow; y++) {
+			const float* row = source + y * width * 4;
+			float* out = destination + y * halfWidth * 4;
+			for (int x = 0; x < halfWidth; x++) {
+				float sum[4] = {};
+				for (int k = 0; k < kernel.count; k++) {
+					int sx = std::min(width - 1, std::max(0, 2 * x + kernel.first + k));
+					for (int c = 0; c < 4; c++)
+						sum[c] += kernel.weights[k] * row[sx * 4 + c];
+				}
+				for (int c = 0; c < 4; c++)
+					out[x * 4 + c] = sum[c];
+			}
+		}
+	}
+
+	// Destination row y is the weighted sum of the source rows around 2y
+	inline void verticalScalar(const float* source, int height, int width, float* destination, const Kernel& kernel, size_t firstRow, size_t lastRow) {
+		size_t rowFloats = (size_t)width * 4;
+		for (size_t y = firstRow; y < lastRow; y++) {
+			float* out = destination + y * rowFloats;
+			std::fill(out, out + rowFloats, 0.0f);
+			for (int k = 0; k < kernel.count; k++) {
+				int sy = std::min(height - 1, std::max(0, 2 * (int)y + kernel.first + k));
+				const float* row = source + sy * rowFloats;
+				for (size_t i = 0; i < rowFloats; i++)
+					out[i] += kernel.weights[k] * row[i];
+			}
+		}
+	}
+
+#ifdef CPU_FEATURES_X86
+	// One RGBA pixel per register
+	CPU_TARGET_SSE2 inline void horizontalSse2(const float* source, int width, float* destination, int halfWidth, const Kernel& kernel, size_t firstRow, size_t lastRow) {
+		for (size_t y = firstRow; y < lastRow; y++) {
+			const float* row = source + y * width * 4;
+			float* out = destination + y * halfWidth * 4;
+			for (int x = 0; x < halfWidth; x++) {
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < kernel.count; k++) {
+					int sx = std::min(width - 1, std::max(0, 2 * x + kernel.first + k));
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(row + sx * 4)));
+				}
+				_mm_storeu_ps(out + x * 4, sum);
+			}
+		}
+	}
+
+	CPU_TARGET_SSE2 inline void verticalSse2(const float* source, int height, int width, float* destination, const Kernel& kernel, size_t firstRow, size_t lastRow) {
+		size_t rowFloats = (size_t)width * 4;
+		for (size_t y = firstRow; y < lastRow; y++) {
+			const float* rows[8];
+			for (int k = 0; k < kernel.count; k++)
+				rows[k] = source + std::min(height - 1, std::max(0, 2 * (int)y + kernel.first + k)) * rowFloats;
+			float* out = destination + y * rowFloats;
+			for (size_t i = 0; i < rowFloats; i += 4) {
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < kernel.count; k++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(rows[k] + i)));
+				_mm_storeu_ps(out + i, sum);
+			}
+		}
+	}
+
+	// Two destination pixels per register
+	CPU_TARGET_AVX2 inline void horizontalAvx2(const float* source, int width, float* destination, int halfWidth, const Kernel& kernel, size_t firstRow, size_t lastRow) {
+		for (size_t y = firstRow; y < lastRow; y++) {
+			const float* row = source + y * width * 4;
+			float* out = destination + y * halfWidth * 4;
+			int x = 0;
+			for (; x + 1 < halfWidth; x += 2) {
+				__m256 sum = _mm256_setzero_ps();
+				for (int k = 0; k < kernel.count; k++) {
+					int sx0 = std::min(width - 1, std::max(0, 2 * x + kernel.first + k));
+					int sx1 = std::min(width - 1, std::max(0, 2 * x + 2 + kernel.first + k));
+					__m256 pixels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(row + sx0 * 4)), _mm_loadu_ps(row + sx1 * 4), 1);
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(kernel.weights[k]), pixels));
+				}
+				_mm256_storeu_ps(out + x * 4, sum);
+			}
+			for (; x < halfWidth; x++) {
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < kernel.count; k++) {
+					int sx = std::min(width - 1, std::max(0, 2 * x + kernel.first + k));
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(row + sx * 4)));
+				}
+				_mm_storeu_ps(out + x * 4, sum);
+			}
+		}
+	}
+
+	// Rows are contiguous, so this takes two pixels (8 floats) at a time
+	CPU_TARGET_AVX2 inline void verticalAvx2(const float* source, int height, int width, float* destination, const Kernel& kernel, size_t firstRow, size_t lastRow) {
+		size_t rowFloats = (size_t)width * 4;
+		for (size_t y = firstRow; y < lastRow; y++) {
+			const float* rows[8];
+			for (int k = 0; k < kernel.count; k++)
+				rows[k] = source + std::min(height - 1, std::max(0, 2 * (int)y + kernel.first + k)) * rowFloats;
+			float* out = destination + y * rowFloats;
+			size_t i = 0;
+			for (; i + 8 <= rowFloats; i += 8) {
+				__m256 sum = _mm256_setzero_ps();
+				for (int k = 0; k < kernel.count; k++)
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(kernel.weights[k]), _mm256_loadu_ps(rows[k] + i)));
+				_mm256_storeu_ps(out + i, sum);
+			}
+			for (; i < rowFloats; i += 4) {
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < kernel.count; k++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(rows[k] + i)));
+				_mm_storeu_ps(out + i, sum);
+			}
+		}
+	}
+#endif
+
+	inline void horizontal(const float* source, int width, float* destination, int halfWidth, const Kernel& kernel, size_t firstRow, size_t lastRow) {
+#ifdef CPU_FEATURES_X86
+		if (simd == CpuFeatures::SIMD_AVX2)
+			return horizontalAvx2(source, width, destination, halfWidth, kernel, firstRow, lastRow);
+		if (simd == CpuFeatures::SIMD_SSE2)
+			return horizontalSse2(source, width, destination, halfWidth, kernel, firstRow, lastRow);
+#endif
+		horizontalScalar(source, width, destination, halfWidth, kernel, firstRow, lastRow);
+	}
+
+	inline void vertical(const float* source, int height, int width, float* destination, const Kernel& kernel, size_t firstRow, size_t lastRow) {
+#ifdef CPU_FEATURES_X86
+		if (simd == CpuFeatures::SIMD_AVX2)
+			return verticalAvx2(source, height, width, destination, kernel, firstRow, lastRow);
+		if (simd == CpuFeatures::SIMD_SSE2)
+			return verticalSse2(source, height, width, destination, kernel, firstRow, lastRow);
+#endif
+		verticalScalar(source, height, width, destination, kernel, firstRow, lastRow);
+	}
+
+	// Splits [0, rows) over the pool, small levels aren't worth waking the threads for
+	inline void forRows(ThreadPool* pool, size_t rows, size_t pixelsPerRow, const std::function<void(size_t, size_t)>& body) {
+		if (pool == nullptr || rows * pixelsPerRow < 64 * 64)
+			body(0, rows);
+		else
+			pool->parallelFor(rows, std::max<size_t>(1, 16384 / std::max<size_t>(1, pixelsPerRow)), body);
+	}
+
+	// Next level of an RGBA float image, half the size in each direction
+	inline std::vector<float> downsample(const std::vector<float>& image, int width, int height, const Kernel& kernel, ThreadPool* pool) {
+		int halfWidth = std::max(1, width / 2), halfHeight = std::max(1, height / 2);
+		// A side of 1 is kept as is, the other one is still halved
+		const Kernel copy = { 0, 1, { 1.0f } };
+		const Kernel& horizontalKernel = width > 1 ? kernel : copy;
+		const Kernel& verticalKernel = height > 1 ? kernel : copy;
+
+		std::vector<float> columns((size_t)halfWidth * height * 4);
+		forRows(pool, height, width, [&](size_t first, size_t last) {
+			horizontal(image.data(), width, columns.data(), halfWidth, horizontalKernel, first, last);
+		});
+
+		std::vector<float> result((size_t)halfWidth * halfHeight * 4);
+		forRows(pool, halfHeight, halfWidth, [&](size_t first, size_t last) {
+			vertical(columns.data(), height, halfWidth, result.data(), verticalKernel, first, last);
+		});
+		return result;
+	}
+
+	// ---- COLOR CONVERSION ---- //
+
+	inline const float* srgbToLinearTable() {
+		static const std::vector<float> table = [] {
+			std::vector<float> values(256);
+			for (int i = 0; i < 256; i++) {
+				double c = i / 255.0;
+				values[i] = (float)(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	// Linear [0, 1] in 4096 steps -> 8 bit sRGB, finer than 8 bits where sRGB needs it
+	inline const uint8_t* linearToSrgbTable() {
+		static const std::vector<uint8_t> table = [] {
+			std::vector<uint8_t> values(4096);
+			for (int i = 0; i < 4096; i++) {
+				double c = i / 4095.0;
+				double s = c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+				values[i] = (uint8_t)std::lround(std::min(1.0, std::max(0.0, s)) * 255.0);
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	inline std::vector<float> toFloat(const uint8_t* pixels, size_t count, int channels, bool srgb) {
+		const float* toLinear = srgbToLinearTable();
+		std::vector<float> image(count * 4);
+		for (size_t i = 0; i < count; i++) {
+			for (int c = 0; c < 4; c++) {
+				uint8_t value = c < channels ? pixels[i * channels + c] : (c == 3 ? 255 : 0);
+				// Channel 3 is alpha only when there are 4, with 2 channels the second is data
+				bool color = srgb && c < 3 && c < channels && !(channels == 2 && c == 1);
+				image[i * 4 + c] = color ? toLinear[value] : value / 255.0f;
+			}
+		}
+		return image;
+	}
+
+	inline void fromFloat(const std::vector<float>& image, int channels, bool srgb, uint8_t* output) {
+		const uint8_t* toSrgb = linearToSrgbTable();
+		size_t count = image.size() / 4;
+		for (size_t i = 0; i < count; i++) {
+			for (int c = 0; c < channels; c++) {
+				// Sharp filters overshoot a little, clamp back to the valid range
+				float value = std::min(1.0f, std::max(0.0f, image[i * 4 + c]));
+				bool color = srgb && c < 3 && !(channels == 2 && c == 1);
+				output[i * channels + c] = color ? toSrgb[(int)(value * 4095.0f + 0.5f)] : (uint8_t)(value * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	// ---- WHOLE CHAINS ---- //
+
+	/*
+		Writes every level after the first of an 8 bit image (1 to 4
+		channels) to output, one after another, chainSize() bytes in total.
+		The levels can have more channels than the image (e.g. RGB -> RGBA,
+		with opaque alpha). output is only written, never read, so it can be
+		mapped GPU memory.
+	*/
+	inline void generate(const uint8_t* pixels, int width, int height, int channels, uint8_t* output, int outputChannels,
+		const Options& options = Options(), ThreadPool* pool = nullptr) {
+		Kernel kernel = makeKernel(options.filter);
+		std::vector<float> level = toFloat(pixels, (size_t)width * height, channels, options.srgb);
+		while (width > 1 || height > 1) {
+			level = downsample(level, width, height, kernel, pool);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			fromFloat(level, outputChannels, options.srgb, output);
+			output += (size_t)width * height * outputChannels;
+		}
+	}
+
+	inline void generate(const uint8_t* pixels, int width, int height, int channels, uint8_t* output, const Options& options = Options(), ThreadPool* pool = nullptr) {
+		generate(pixels, width, height, channels, output, channels, options, pool);
+	}
+
+	// Same for float images (e.g. HDR), no sRGB and no clamping
+	inline void generate(const float* pixels, int width, int height, int channels, float* output, const Options& options = Options(), ThreadPool* pool = nullptr) {
+		Kernel kernel = makeKernel(options.filter);
+		std::vector<float> level((size_t)width * height * 4, 1.0f);
+		for (size_t i = 0; i < (size_t)width * height; i++) {
+			for (int c = 0; c < channels; c++)
+				level[i * 4 + c] = pixels[i * channels + c];
+		}
+		while (width > 1 || height > 1) {
+			level = downsample(level, width, height, kernel, pool);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			for (size_t i = 0; i < (size_t)width * height; i++) {
+				for (int c = 0; c < channels; c++)
+					output[i * channels + c] = level[i * 4 + c];
+			}
+			output += (size_t)width * height * channels;
+		}
+	}
+
+	// Every level after the first as separate images, for the cooker
+	inline std::vector<std::vector<uint8_t>> generateLevels(const uint8_t* pixels, int width, int height, int channels, const Options& options = Options(), ThreadPool* pool = nullptr) {
+		std::vector<uint8_t> chain(chainSize(width, height, channels));
+		generate(pixels, width, height, channels, chain.data(), options, pool);
+
+		std::vector<std::vector<uint8_t>> levels;
+		size_t offset = 0;
+		while (width > 1 || height > 1) {
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			size_t size = (size_t)width * height * channels;
+			levels.emplace_back(chain.begin() + offset, chain.begin() + offset + size);
+			offset += size;
+		}
+		return levels;
+	}
+}
+
+#endif
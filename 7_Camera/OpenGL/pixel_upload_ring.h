@@ -0,0 +1,222 @@
+#ifndef PIXEL_UPLOAD_RING_H
+#define PIXEL_UPLOAD_RING_H
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+
+/*
+	Ring buffer of pixel data for streaming texture uploads.
+
+	glTexImage2D from a client pointer makes the driver copy the pixels
+	before the call returns. Instead, this keeps one GL_PIXEL_UNPACK_BUFFER
+	mapped for its whole life (glBufferStorage with MAP_PERSISTENT|MAP_COHERENT):
+	decoder threads write pixels straight into the mapped memory, and the GL
+	thread only issues glTexSubImage2D with an offset into the buffer, which
+	the GPU reads asynchronously.
+
+	A region can't be reused until the GPU has read it, so after the upload
+	commands a fence is put behind each region, and retire() frees regions
+	(in allocation order) whose fence has signaled.
+
+	allocate() may be called from any thread and blocks while the ring is full.
+	Everything else must be called on the GL thread.
+*/
+class PixelUploadRing {
+
+	struct Region {
+		uint64_t id;
+		size_t offset;
+		size_t size;
+		GLsync fence;
+		bool submitted;
+	};
+
+public:
+	struct Allocation {
+		uint64_t id = 0;
+		size_t offset = 0;
+		unsigned char* pointer = nullptr;
+	};
+
+	// Pixel unpack buffer ID
+	unsigned int PBO = 0;
+	size_t capacity = 0;
+
+	explicit PixelUploadRing(size_t capacity) : capacity(capacity) {
+		glGenBuffers(1, &PBO);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, flags);
+		// While a buffer is bound to GL_PIXEL_UNPACK_BUFFER, every pixel pointer
+		// is read as an offset into it, so it must only stay bound during uploads
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (mapped == nullptr) {
+			std::cout << "ERROR::PIXEL_UPLOAD_RING::MAP_FAILED\n" << std::endl;
+			glDeleteBuffers(1, &PBO);
+			PBO = 0;
+			this->capacity = 0;
+		}
+	}
+
+	bool valid() const {
+		return mapped != nullptr;
+	}
+
+	/*
+		Reserves size bytes for writing. Blocks until there's room, returns
+		an allocation with a null pointer if the ring could never hold it.
+	*/
+	Allocation allocate(size_t size) {
+		Allocation allocation;
+		size = align(size);
+		if (mapped == nullptr || size > capacity)
+			return allocation;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			if (closed)
+				return allocation;
+
+			size_t offset = head;
+			bool fits;
+			if (regions.empty()) {
+				offset = head = tail = 0;
+				fits = true;
+			}
+			else if (head >= tail) {
+				// Free space is [head, capacity) and [0, tail), head can't
+				// catch up with tail or a full ring would look empty
+				if (head + size < capacity || (head + size == capacity && tail != 0))
+					fits = true;
+				else {
+					offset = 0;
+					fits = size < tail;
+				}
+			}
+			else {
+				// Free space is [head, tail)
+				fits = head + size < tail;
+			}
+
+			if (fits) {
+				// The space skipped at the end when wrapping becomes part of this region
+				size_t regionStart = offset == 0 && head != 0 ? head : offset;
+				size_t regionSize = offset == 0 && head != 0 ? capacity - head + size : size;
+				allocation.id = ++lastId;
+				allocation.offset = offset;
+				allocation.pointer = mapped + offset;
+				regions.push_back({ allocation.id, regionStart, regionSize, NULL, false });
+				head = offset + size;
+				if (head == capacity)
+					head = 0;
+				return allocation;
+			}
+			freed.wait(lock);
+		}
+	}
+
+	// Binds the buffer so the following glTexSubImage2D calls read from it
+	void bind() {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+	}
+
+	void unbind() {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	// Marks the allocation as used by the upload commands issued so far
+	void submit(const Allocation& allocation) {
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		std::lock_guard<std::mutex> lock(mutex);
+		for (Region& region : regions) {
+			if (region.id == allocation.id) {
+				region.fence = fence;
+				region.submitted = true;
+				return;
+			}
+		}
+		glDeleteSync(fence);
+	}
+
+	// Gives back an allocation that was never used for an upload (e.g. a failed decode)
+	void cancel(const Allocation& allocation) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (Region& region : regions) {
+			if (region.id == allocation.id)
+				region.submitted = true;
+		}
+	}
+
+	// Frees the oldest regions the GPU is done with, call it once per frame
+	void retire() {
+		bool any = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (!regions.empty() && regions.front().submitted) {
+				Region& region = regions.front();
+				if (region.fence != NULL) {
+					// Timeout 0: only asks, never waits. The flush makes sure
+					// the fence reaches the GPU even if nothing else is drawn
+					GLenum status = glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+					if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+						break;
+					glDeleteSync(region.fence);
+				}
+				tail = region.offset + region.size;
+				if (tail >= capacity)
+					tail -= capacity;
+				regions.pop_front();
+				any = true;
+			}
+		}
+		if (any)
+			freed.notify_all();
+	}
+
+	// Unmaps and deletes the buffer, waking any thread still waiting for space
+	void destroy() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			for (Region& region : regions) {
+				if (region.fence != NULL)
+					glDeleteSync(region.fence);
+			}
+			regions.clear();
+		}
+		freed.notify_all();
+
+		if (PBO != 0) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &PBO);
+			PBO = 0;
+		}
+		mapped = nullptr;
+	}
+
+private:
+	unsigned char* mapped = nullptr;
+	std::mutex mutex;
+	std::condition_variable freed;
+	std::deque<Region> regions;
+	size_t head = 0;
+	size_t tail = 0;
+	uint64_t lastId = 0;
+	bool closed = false;
+
+	// Offsets stay aligned so any pixel format can be read from them
+	static size_t align(size_t size) {
+		return (size + 255) & ~(size_t)255;
+	}
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstdint>
+#include <cstdio>
+
+/*
+	On-disk cache of linked shader programs.
+
+	Compiling and linking GLSL is the slowest part of creating a program,
+	so after the first link the driver's own binary of the program is
+	saved with glGetProgramBinary and loaded back next launch with glProgramBinary.
+
+	The binary only works with the same driver that produced it, so the cache key
+	also hashes GL_RENDERER and GL_VERSION. Even then the driver may refuse
+	a binary (e.g. after an update), in that case the caller compiles from source.
+*/
+namespace ProgramCache {
+
+	// Directory where the binaries are stored, relative to the working directory
+	inline std::string directory = "shader_cache";
+
+	constexpr uint32_t fileMagic = 0x42505347; // "GSPB"
+
+	inline uint64_t hashBytes(uint64_t hash, const char* data, size_t length) {
+		// 64 bit FNV-1a
+		for (size_t i = 0; i < length; i++) {
+			hash ^= (uint8_t)data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	inline uint64_t hashString(uint64_t hash, const std::string& text) {
+		hash = hashBytes(hash, text.data(), text.size());
+		// Separator so "ab"+"c" and "a"+"bc" don't give the same key
+		return hashBytes(hash, "\0", 1);
+	}
+
+	// Hash of a whole source, the same one Tools/ShaderEmbed stores for embedded shaders
+	inline uint64_t contentHash(const char* data, size_t length) {
+		return hashBytes(14695981039346656037ull, data, length);
+	}
+
+	// Mixes in the driver that builds the program, its binaries are useless to any other
+	inline uint64_t hashDriver(uint64_t hash) {
+		const char* renderer = (const char*)glGetString(GL_RENDERER);
+		const char* version = (const char*)glGetString(GL_VERSION);
+		hash = hashString(hash, renderer ? renderer : "");
+		return hashString(hash, version ? version : "");
+	}
+
+	// Key of a program: its sources (by content hash), its defines and the driver that builds it
+	inline uint64_t programKey(uint64_t vsHash, uint64_t fsHash, const std::string& defines = "") {
+		uint64_t hash = 14695981039346656037ull;
+		hash = hashBytes(hash, (const char*)&vsHash, sizeof(vsHash));
+		hash = hashBytes(hash, (const char*)&fsHash, sizeof(fsHash));
+		hash = hashString(hash, defines);
+		return hashDriver(hash);
+	}
+
+	inline uint64_t programKey(const std::string& vsSource, const std::string& fsSource, const std::string& defines = "") {
+		return programKey(contentHash(vsSource.data(), vsSource.size()), contentHash(fsSource.data(), fsSource.size()), defines);
+	}
+
+	// Key of a separable program with a single stage (see shader_pipeline.h)
+	inline uint64_t stageKey(uint64_t sourceHash, GLenum stage, const std::string& defines = "") {
+		uint64_t hash = 14695981039346656037ull;
+		hash = hashString(hash, "separable");
+		uint32_t stage32 = (uint32_t)stage;
+		hash = hashBytes(hash, (const char*)&stage32, sizeof(stage32));
+		hash = hashBytes(hash, (const char*)&sourceHash, sizeof(sourceHash));
+		hash = hashString(hash, defines);
+		return hashDriver(hash);
+	}
+
+	inline std::string binaryPath(uint64_t key) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+		return directory + "/" + name;
+	}
+
+	// The driver must support at least one binary format for any of this to work
+	inline bool supported() {
+		int formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	/*
+		Returns a linked program created from the cached binary,
+		or 0 if there's no binary for the key or the driver rejected it.
+	*/
+	inline unsigned int load(uint64_t key) {
+		if (!supported())
+			return 0;
+
+		std::ifstream file(binaryPath(key), std::ios::binary);
+		if (!file)
+			return 0;
+
+		uint32_t magic = 0, format = 0, length = 0;
+		file.read((char*)&magic, sizeof(magic));
+		file.read((char*)&format, sizeof(format));
+		file.read((char*)&length, sizeof(length));
+		if (!file || magic != fileMagic || length == 0)
+			return 0;
+
+		std::vector<char> binary(length);
+		file.read(binary.data(), length);
+		if (!file)
+			return 0;
+
+		unsigned int program = glCreateProgram();
+		glProgramBinary(program, (GLenum)format, binary.data(), (GLsizei)length);
+
+		// A rejected binary leaves the program unlinked
+		int success;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (success == GL_FALSE) {
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	/*
+		Saves the binary of a linked program. The program must've been linked
+		after setting GL_PROGRAM_BINARY_RETRIEVABLE_HINT to GL_TRUE.
+	*/
+	inline void store(uint64_t key, unsigned int program) {
+		if (!supported())
+			return;
+
+		int length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		std::vector<char> binary(length);
+		GLenum format;
+		glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+
+		// Written next to the final file and renamed into place, so a crash
+		// in the middle can't leave a truncated binary for the next launch
+		std::string path = binaryPath(key);
+		std::string temporaryPath = path + ".tmp";
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cout << "ERROR::PROGRAM_CACHE::FILE_NOT_SUCCESFULLY_WRITTEN\n" << temporaryPath << std::endl;
+			return;
+		}
+		uint32_t magic = fileMagic, format32 = format, length32 = (uint32_t)length;
+		file.write((const char*)&magic, sizeof(magic));
+		file.write((const char*)&format32, sizeof(format32));
+		file.write((const char*)&length32, sizeof(length32));
+		file.write(binary.data(), length);
+		file.close();
+		if (!file) {
+			std::cout << "ERROR::PROGRAM_CACHE::FILE_NOT_SUCCESFULLY_WRITTEN\n" << temporaryPath << std::endl;
+			std::filesystem::remove(temporaryPath, error);
+			return;
+		}
+
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error) {
+			std::cout << "ERROR::PROGRAM_CACHE::FILE_NOT_SUCCESFULLY_RENAMED\n" << path << std::endl;
+			std::filesystem::remove(temporaryPath, error);
+		}
+	}
+}
+
+#endif
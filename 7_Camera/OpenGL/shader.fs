@@ -1,14 +1,32 @@
 #version 460 core
-out vec4 FragColor;
+#ifdef BINDLESS
+// Textures are sampled through handles from the material table, never bound
+#extension GL_ARB_bindless_texture : require
+#endif
+layout (location = 0) out vec4 FragColor;
 
-in vec2 TexCoord;
+layout (location = 0) in vec2 TexCoord;
 
-uniform sampler2D texture1;
-uniform sampler2D texture2;
+// Explicit bindings and locations, SPIR-V shaders have no names to look them up by
+#include "material_table.glsl"
+
+// Index in the material table, the only thing set per draw
+layout (location = 2) uniform int materialId;
+
+// How much of texture2 is mixed in, either fixed at compile time or set from the program
+#ifdef USE_MIX_UNIFORM
+layout (location = 1) uniform float mixAmount;
+#else
+#ifndef MIX_AMOUNT
+#define MIX_AMOUNT 0.2
+#endif
+const float mixAmount = MIX_AMOUNT;
+#endif
 
 void main()
 {
-	FragColor = mix(texture(texture1, TexCoord),
-					texture(texture2, TexCoord), 0.2);
+	Material material = materials[materialId];
+	FragColor = mix(sampleMaterial(material.textures[0], TexCoord),
+					sampleMaterial(material.textures[1], TexCoord), mixAmount);
 }
 
@@ -7,50 +7,113 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <cstdint>
+
+#include "program_cache.h"
+#include "shader_preprocessor.h"
+#include "camera_block.h"
+#include "gl_state.h"
+
+/*
+	FNV-1a hash of a uniform name. It's constexpr so names written
+	in the source code can be hashed by the compiler instead of at runtime.
+*/
+constexpr uint32_t hashUniformName(const char* name) {
+	uint32_t hash = 2166136261u;
+	while (*name != '\0') {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*
+	Precomputed name of a uniform. Declare it constexpr outside the render loop, e.g.
+		constexpr UniformHandle modelUniform("model");
+	or use the "model"_u literal, so the setters don't build a std::string
+	nor ask the driver for the location every call.
+
+	Debug builds keep the name too, so a lookup can check that the slot
+	its hash falls into really is that uniform.
+*/
+struct UniformHandle {
+	uint32_t hash;
+#ifdef _DEBUG
+	const char* name;
+	constexpr explicit UniformHandle(const char* name) : hash(hashUniformName(name)), name(name) {}
+#else
+	constexpr explicit UniformHandle(const char* name) : hash(hashUniformName(name)) {}
+#endif
+};
+
+constexpr UniformHandle operator"" _u(const char* name, std::size_t) {
+	return UniformHandle(name);
+}
 
 class Shader {
 
 public:
 	// Shader program ID
 	unsigned int ID;
-	// Constructor reads and builds the shader
-	Shader(const char* vertexPath, const char* fragmentPath) {
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try {
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+	/*
+		Constructor reads and builds the shader.
+		The files go through ShaderPreprocessor first, so they can #include
+		other files and be specialized with defines.
+	*/
+	Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines = ShaderDefines()) {
+		std::string vertexCode = ShaderPreprocessor::process(vertexPath, defines);
+		std::string fragmentCode = ShaderPreprocessor::process(fragmentPath, defines);
+
+		build(vertexCode.c_str(), fragmentCode.c_str(), ProgramCache::programKey(vertexCode, fragmentCode, ShaderPreprocessor::definesKey(defines)));
+	}
+
+	/*
+		Constructor for shaders embedded in the executable (embedded_shaders.h).
+		When there's nothing to preprocess, the embedded text goes straight to
+		the driver and its precomputed hash is the cache key: no file is opened
+		and the source is never copied.
+	*/
+	Shader(const EmbeddedShader& vertex, const EmbeddedShader& fragment, const ShaderDefines& defines = ShaderDefines()) {
+		if (ShaderPreprocessor::diskOverride || vertex.hasIncludes || fragment.hasIncludes || !defines.empty()) {
+			std::string vertexCode = ShaderPreprocessor::process(std::string(vertex.name), defines);
+			std::string fragmentCode = ShaderPreprocessor::process(std::string(fragment.name), defines);
+			build(vertexCode.c_str(), fragmentCode.c_str(), ProgramCache::programKey(vertexCode, fragmentCode, ShaderPreprocessor::definesKey(defines)));
 		}
-		catch (std::ifstream::failure& e) {
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFFULY_READ\n" << std::endl;
+		else {
+			build(vertex.source.data(), fragment.source.data(), ProgramCache::programKey(vertex.hash, fragment.hash));
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
+	}
 
-		ID = Shader::createShaderProgram(vShaderCode, fShaderCode);
+	// Constructor for a program that was already linked somewhere else (e.g. by ShaderCompiler)
+	explicit Shader(unsigned int program) {
+		ID = program;
+		if (ID != 0)
+			reflectProgram();
+	}
 
+	/*
+		Swaps in a new linked program (e.g. a hot-reloaded one) and deletes the old one.
+		Uniform values live in the program, so they have to be set again afterwards.
+	*/
+	void replaceProgram(unsigned int program) {
+		if (ID != 0) {
+			GLState::forgetProgram(ID);
+			glDeleteProgram(ID);
+		}
+		if (usesCameraBlock)
+			CameraBlock::programCount--;
+		usesCameraBlock = false;
+		ID = program;
+		if (ID != 0)
+			reflectProgram();
 	}
 
 	// Use/Activate the shader
 	void use() {
 		// Every shader and rendering after glUseProgram will use this program obj and it's shaders
-		glUseProgram(ID);
+		// (GLState skips the call if it's already the program in use)
+		GLState::useProgram(ID);
 	}
 
 	/*
@@ -70,22 +133,243 @@ public:
 
 	*/
 	void setBool(const std::string& name, bool value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(uniformLocation(UniformHandle(name.c_str())), (int)value);
 	}
 
 	void setInt(const std::string& name, int value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(uniformLocation(UniformHandle(name.c_str())), value);
 	}
 
 	void setFloat(const std::string& name, float value) const {
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(uniformLocation(UniformHandle(name.c_str())), value);
+	}
+
+	void setVec2(const std::string& name, const glm::vec2& value) const {
+		glUniform2fv(uniformLocation(UniformHandle(name.c_str())), 1, glm::value_ptr(value));
+	}
+
+	void setVec4(const std::string& name, const glm::vec4& value) const {
+		glUniform4fv(uniformLocation(UniformHandle(name.c_str())), 1, glm::value_ptr(value));
+	}
+
+	void setMat4(const std::string& name, GLboolean tranpose, const glm::mat4& matrix) const {
+		glUniformMatrix4fv(uniformLocation(UniformHandle(name.c_str())), 1, tranpose, glm::value_ptr(matrix));
+	}
+
+	/*
+		Same setters but taking an already hashed name,
+		these are the ones to use inside the render loop.
+	*/
+	void setBool(UniformHandle uniform, bool value) const {
+		glUniform1i(uniformLocation(uniform), (int)value);
+	}
+
+	void setInt(UniformHandle uniform, int value) const {
+		glUniform1i(uniformLocation(uniform), value);
+	}
+
+	void setFloat(UniformHandle uniform, float value) const {
+		glUniform1f(uniformLocation(uniform), value);
+	}
+
+	void setVec2(UniformHandle uniform, const glm::vec2& value) const {
+		glUniform2fv(uniformLocation(uniform), 1, glm::value_ptr(value));
+	}
+
+	void setVec4(UniformHandle uniform, const glm::vec4& value) const {
+		glUniform4fv(uniformLocation(uniform), 1, glm::value_ptr(value));
+	}
+
+	void setMat4(UniformHandle uniform, GLboolean tranpose, const glm::mat4& matrix) const {
+		glUniformMatrix4fv(uniformLocation(uniform), 1, tranpose, glm::value_ptr(matrix));
+	}
+
+	/*
+		Adds uniforms whose locations the driver can't report by name, e.g. in
+		programs made from SPIR-V, where names don't exist and the locations
+		come from explicit layout(location = N) qualifiers.
+	*/
+	void addUniformLocations(const std::vector<std::pair<std::string, int>>& locations) {
+		std::vector<UniformSlot> uniforms;
+		for (const UniformSlot& slot : uniformTable) {
+			if (slot.location != -1)
+				uniforms.push_back(slot);
+		}
+		for (const auto& uniform : locations)
+			uniforms.push_back({ hashUniformName(uniform.first.c_str()), uniform.second, uniform.first });
+		fillUniformTable(uniforms);
 	}
 
-	void setMat4(const std::string& name, GLboolean tranpose, glm::mat4 matrix) const {
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, tranpose, glm::value_ptr(matrix));
+	/*
+		Location of a uniform from the table built at link time.
+		Returns -1 (which glUniform* silently ignores) if the
+		uniform isn't active in the program, same as glGetUniformLocation.
+	*/
+	int uniformLocation(UniformHandle uniform) const {
+		if (uniformTable.empty())
+			return -1;
+		const UniformSlot& slot = uniformTable[slotIndex(uniform.hash)];
+		if (slot.hash != uniform.hash)
+			return -1;
+#ifdef _DEBUG
+		// Same hash, different name: not in the program (or dropped as a collision)
+		if (slot.name != uniform.name)
+			return -1;
+#endif
+		return slot.location;
 	}
 
 private:
+	// Creates the program from the final sources, trying the binary cache first
+	void build(const char* vShaderCode, const char* fShaderCode, uint64_t cacheKey) {
+		// Try the linked binary from a previous launch before compiling anything
+		ID = ProgramCache::load(cacheKey);
+
+		if (ID == 0) {
+			ID = Shader::createShaderProgram(vShaderCode, fShaderCode);
+			if (ID != 0)
+				ProgramCache::store(cacheKey, ID);
+		}
+
+		if (ID != 0)
+			reflectProgram();
+	}
+
+	struct UniformSlot {
+		uint32_t hash = 0;
+		int location = -1;
+		std::string name;
+	};
+
+	/*
+		Open addressing table without collisions (a perfect hash):
+		the seed and the size are chosen when building it so that every
+		active uniform falls into its own slot, then a lookup is exactly one probe.
+	*/
+	std::vector<UniformSlot> uniformTable;
+	uint32_t uniformSeed = 0;
+	// 32 - log2(table size): the slot is the top bits of the mixed hash
+	uint32_t uniformShift = 32;
+	bool usesCameraBlock = false;
+
+	unsigned int slotIndex(uint32_t hash) const {
+		uint32_t mixed = (hash ^ uniformSeed) * 0x9E3779B1u;
+		return mixed >> uniformShift;
+	}
+
+	// Everything the setters need to know about a freshly linked program
+	void reflectProgram() {
+		bindCameraBlock();
+		buildUniformTable();
+	}
+
+	/*
+		Connect the program's CameraBlock (if it declares one) to the shared
+		binding point, for shaders that don't use layout(binding = ...) themselves.
+	*/
+	void bindCameraBlock() {
+		unsigned int blockIndex = glGetUniformBlockIndex(ID, "CameraBlock");
+		if (blockIndex == GL_INVALID_INDEX)
+			return;
+		glUniformBlockBinding(ID, blockIndex, CAMERA_BLOCK_BINDING);
+		usesCameraBlock = true;
+		CameraBlock::programCount++;
+	}
+
+	/*
+		Ask the linked program for all of its active uniforms once,
+		instead of calling glGetUniformLocation on every setter call.
+	*/
+	void buildUniformTable() {
+		std::vector<UniformSlot> uniforms;
+		uniformTable.clear();
+
+		int count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<char> name(maxLength > 0 ? maxLength : 1);
+
+		for (int i = 0; i < count; i++) {
+			int size;
+			GLenum type;
+			glGetActiveUniform(ID, (GLuint)i, maxLength, NULL, &size, &type, name.data());
+
+			// Uniforms inside a uniform block don't have a location
+			int location = glGetUniformLocation(ID, name.data());
+			if (location == -1)
+				continue;
+
+			uniforms.push_back({ hashUniformName(name.data()), location, name.data() });
+
+			// Arrays are reported as "name[0]", also make "name" find them
+			std::string base(name.data());
+			if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0) {
+				base.resize(base.size() - 3);
+				uniforms.push_back({ hashUniformName(base.c_str()), location, base });
+			}
+		}
+
+		fillUniformTable(uniforms);
+	}
+
+	void fillUniformTable(std::vector<UniformSlot>& uniforms) {
+		uniformTable.clear();
+		if (uniforms.empty())
+			return;
+
+		/*
+			Two different names with the same hash can't be told apart by
+			the setters, so both are dropped: they find no location (-1)
+			instead of one of them silently setting the other's uniform.
+			The same name given twice (e.g. by addUniformLocations) is kept once.
+		*/
+		for (size_t i = 0; i < uniforms.size(); i++) {
+			bool collided = false;
+			for (size_t j = i + 1; j < uniforms.size(); j++) {
+				if (uniforms[j].hash != uniforms[i].hash)
+					continue;
+				if (uniforms[j].name != uniforms[i].name) {
+					std::cout << "WARNING::SHADER::UNIFORM_HASH_COLLISION\n" << uniforms[i].name << " and " << uniforms[j].name << std::endl;
+					collided = true;
+				}
+				uniforms.erase(uniforms.begin() + j--);
+			}
+			if (collided)
+				uniforms.erase(uniforms.begin() + i--);
+		}
+		if (uniforms.empty())
+			return;
+
+		// Look for a seed without collisions, growing the table if it takes too long
+		uint32_t bits = 1;
+		while ((1u << bits) < uniforms.size() * 2)
+			bits++;
+
+		// The mixed hashes of different names are all different, so a big enough
+		// table always works, the limit only stops a runaway loop
+		for (uint32_t maxBits = bits + 8; bits <= maxBits; bits++) {
+			uint32_t size = 1u << bits;
+			uniformShift = 32 - bits;
+			for (uniformSeed = 0; uniformSeed < 64; uniformSeed++) {
+				uniformTable.assign(size, UniformSlot());
+				bool collision = false;
+				for (const UniformSlot& uniform : uniforms) {
+					UniformSlot& slot = uniformTable[slotIndex(uniform.hash)];
+					if (slot.location != -1) {
+						collision = true;
+						break;
+					}
+					slot = uniform;
+				}
+				if (!collision)
+					return;
+			}
+		}
+
+		std::cout << "ERROR::SHADER::UNIFORM_TABLE_NOT_BUILT\n" << uniforms.size() << " uniforms" << std::endl;
+		uniformTable.clear();
+	}
+
 	unsigned int compileShader(unsigned int shaderType, const char* source) {
 
 		/* VERTEX SHADER: in this case will tell where to draw each vertex i.e. it's position */
@@ -128,6 +412,8 @@ private:
 		// Attach shaders to shader program
 		glAttachShader(program, vertexShader);
 		glAttachShader(program, fragmentShader);
+		// Allow glGetProgramBinary on the result so it can be cached on disk
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(program); // Link shaders
 
 		// Check if the shaders were linked together
@@ -2,10 +2,11 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 
-out vec2 TexCoord;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (location = 0) out vec2 TexCoord;
+// Needed when this is linked as a separable stage (ShaderPipeline)
+out gl_PerVertex { vec4 gl_Position; };
+layout (location = 0) uniform mat4 model;
+#include "camera_block.glsl"
 
 void main()
 {
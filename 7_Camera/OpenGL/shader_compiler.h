@@ -0,0 +1,244 @@
+#ifndef SHADER_COMPILER_H
+#define SHADER_COMPILER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <iostream>
+
+#include "shader.h"
+#include "program_cache.h"
+#include "shader_preprocessor.h"
+#include "gl_extensions.h"
+
+// GL_KHR_parallel_shader_compile isn't part of the generated glad, so it's loaded by hand
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/*
+	Compiles many shader programs at once.
+
+	Shader::compileShader asks for GL_COMPILE_STATUS right after glCompileShader,
+	which makes the driver finish that compile before the next one can even start.
+	Here every program is submitted first (compile + link, no status queries)
+	and the status is only asked for when the program is actually needed.
+
+	If the driver has GL_KHR_parallel_shader_compile the compiles run on driver
+	threads, and GL_COMPLETION_STATUS_KHR tells whether a program is done
+	without blocking. Without the extension ready() just returns true and
+	get() blocks like before, but all the compiles are still queued up front.
+*/
+class ShaderCompiler {
+
+	typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+	struct PendingState {
+		unsigned int program = 0;
+		unsigned int vertexShader = 0;
+		unsigned int fragmentShader = 0;
+		uint64_t cacheKey = 0;
+		bool finished = false;
+		bool parallel = false;
+		// Whether the program came from ProgramCache::load, and how long it took to be ready
+		bool fromCache = false;
+		std::chrono::steady_clock::time_point submitted;
+		double milliseconds = 0.0;
+	};
+
+public:
+	/*
+		Future-like handle of a program being compiled.
+		ready() never blocks, get() waits if needed and returns
+		the linked program ID (0 if compiling or linking failed).
+		Once it's finished, fromBinaryCache() and buildMilliseconds() tell
+		whether the on-disk cache had it and the time from submit() until
+		it was ready (with parallel compiles, that includes whatever the
+		caller did in the meantime).
+	*/
+	class ProgramFuture {
+	public:
+		ProgramFuture() {}
+
+		bool valid() const {
+			return state != nullptr;
+		}
+
+		bool ready() const {
+			if (!state || state->finished || !state->parallel)
+				return true;
+			int done = GL_FALSE;
+			glGetProgramiv(state->program, GL_COMPLETION_STATUS_KHR, &done);
+			return done == GL_TRUE;
+		}
+
+		unsigned int get() {
+			if (!state)
+				return 0;
+			if (!state->finished)
+				ShaderCompiler::finish(*state);
+			return state->program;
+		}
+
+		bool fromBinaryCache() const {
+			return state && state->fromCache;
+		}
+
+		double buildMilliseconds() const {
+			return state ? state->milliseconds : 0.0;
+		}
+
+	private:
+		friend class ShaderCompiler;
+		std::shared_ptr<PendingState> state;
+	};
+
+	bool parallel = false;
+
+	// loadProc is the same function given to gladLoadGLLoader, e.g. glfwGetProcAddress
+	explicit ShaderCompiler(GLADloadproc loadProc, unsigned int threads = 0xFFFFFFFF) {
+		if (!hasGLExtension("GL_KHR_parallel_shader_compile"))
+			return;
+
+		PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads =
+			(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loadProc("glMaxShaderCompilerThreadsKHR");
+		if (maxShaderCompilerThreads != NULL) {
+			// 0xFFFFFFFF lets the driver pick as many threads as it wants
+			maxShaderCompilerThreads(threads);
+			parallel = true;
+		}
+	}
+
+	// Queues a program, nothing here waits for the driver
+	ProgramFuture submit(const std::string& vsSource, const std::string& fsSource, const std::string& definesKey = "") {
+		return submit(vsSource.c_str(), fsSource.c_str(), ProgramCache::programKey(vsSource, fsSource, definesKey));
+	}
+
+	ProgramFuture submit(const char* vsSource, const char* fsSource, uint64_t cacheKey) {
+		ProgramFuture future;
+		future.state = std::make_shared<PendingState>();
+		PendingState& state = *future.state;
+		state.parallel = parallel;
+		state.submitted = std::chrono::steady_clock::now();
+
+		// A cached binary doesn't need compiling at all
+		state.cacheKey = cacheKey;
+		state.program = ProgramCache::load(state.cacheKey);
+		if (state.program != 0) {
+			state.finished = true;
+			state.fromCache = true;
+			state.milliseconds = elapsedMilliseconds(state);
+			return future;
+		}
+
+		state.vertexShader = submitShader(GL_VERTEX_SHADER, vsSource);
+		state.fragmentShader = submitShader(GL_FRAGMENT_SHADER, fsSource);
+
+		state.program = glCreateProgram();
+		glAttachShader(state.program, state.vertexShader);
+		glAttachShader(state.program, state.fragmentShader);
+		glProgramParameteri(state.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(state.program);
+
+		pending.push_back(future.state);
+		return future;
+	}
+
+	ProgramFuture submitFiles(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines = ShaderDefines()) {
+		return submit(ShaderPreprocessor::process(vertexPath, defines), ShaderPreprocessor::process(fragmentPath, defines),
+			ShaderPreprocessor::definesKey(defines));
+	}
+
+	// Same as Shader's embedded constructor: no copies unless there's something to preprocess
+	ProgramFuture submit(const EmbeddedShader& vertex, const EmbeddedShader& fragment, const ShaderDefines& defines = ShaderDefines()) {
+		if (ShaderPreprocessor::diskOverride || vertex.hasIncludes || fragment.hasIncludes || !defines.empty())
+			return submitFiles(std::string(vertex.name).c_str(), std::string(fragment.name).c_str(), defines);
+		return submit(vertex.source.data(), fragment.source.data(), ProgramCache::programKey(vertex.hash, fragment.hash));
+	}
+
+	/*
+		Finishes the programs that are already done without waiting for the rest,
+		meant to be called once per frame (or between loading steps).
+		Returns how many programs are still compiling.
+	*/
+	size_t poll() {
+		for (size_t i = 0; i < pending.size();) {
+			ProgramFuture future;
+			future.state = pending[i];
+			if (future.ready()) {
+				future.get();
+				pending[i] = pending.back();
+				pending.pop_back();
+			}
+			else {
+				i++;
+			}
+		}
+		return pending.size();
+	}
+
+	// Blocks until every submitted program is finished
+	void finishAll() {
+		for (std::shared_ptr<PendingState>& state : pending) {
+			if (!state->finished)
+				finish(*state);
+		}
+		pending.clear();
+	}
+
+private:
+	std::vector<std::shared_ptr<PendingState>> pending;
+
+	static unsigned int submitShader(unsigned int shaderType, const char* source) {
+		unsigned int id = glCreateShader(shaderType);
+		glShaderSource(id, 1, &source, NULL);
+		glCompileShader(id);
+		// No GL_COMPILE_STATUS here, that's checked in finish()
+		return id;
+	}
+
+	// Only called once the program is needed, this is where the status queries happen
+	static void finish(PendingState& state) {
+		state.finished = true;
+
+		int success;
+		char infoLog[1024];
+		glGetProgramiv(state.program, GL_LINK_STATUS, &success);
+		if (success == GL_FALSE) {
+			// Point at the shader that failed, if it was a compile error
+			unsigned int shaders[] = { state.vertexShader, state.fragmentShader };
+			for (unsigned int shader : shaders) {
+				int compiled;
+				glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+				if (compiled == GL_FALSE) {
+					glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+					std::cout << "ERROR::SHADER::" << (shader == state.vertexShader ? "VERTEX" : "FRAGMENT") << "::COMPILATION_FAILED\n" <<
+						infoLog << std::endl;
+				}
+			}
+			glGetProgramInfoLog(state.program, 1024, NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
+
+			glDeleteProgram(state.program);
+			state.program = 0;
+		}
+		else {
+			ProgramCache::store(state.cacheKey, state.program);
+		}
+
+		glDeleteShader(state.vertexShader);
+		glDeleteShader(state.fragmentShader);
+		state.vertexShader = state.fragmentShader = 0;
+		state.milliseconds = elapsedMilliseconds(state);
+	}
+
+	static double elapsedMilliseconds(const PendingState& state) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - state.submitted).count();
+	}
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef SHADER_PIPELINE_H
+#define SHADER_PIPELINE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <iostream>
+
+#include "shader.h"
+#include "shader_preprocessor.h"
+#include "program_cache.h"
+#include "embedded_shader.h"
+#include "gl_state.h"
+
+/*
+	Separable shader programs (GL_ARB_separate_shader_objects, core since 4.1).
+
+	A normal program links one vertex shader with one fragment shader, so the
+	same vertex shader used with 5 fragment shaders gets compiled and linked
+	5 times. Here each stage is linked alone into its own separable program,
+	and a program pipeline object combines a vertex stage with a fragment
+	stage without linking anything. Link work grows with the number of
+	different stages, not with the number of combinations.
+
+	Separable vertex shaders must redeclare the gl_PerVertex block they write:
+		out gl_PerVertex { vec4 gl_Position; };
+	and the outputs of one stage must match the inputs of the next by name and type.
+*/
+class ShaderStageCache {
+
+public:
+	// How many stages had to be compiled and linked (cache misses)
+	unsigned int linkCount = 0;
+
+	/*
+		Returns the separable program for this stage, building it the first time.
+		A file is only read and preprocessed the first time it's asked for
+		with these defines, call clear() to pick up edits.
+	*/
+	Shader& stage(GLenum stageType, const char* path, const ShaderDefines& defines = ShaderDefines()) {
+		std::string definesKey = ShaderPreprocessor::definesKey(defines);
+		std::string fileKey = std::to_string(stageType) + ";" + path + ";" + definesKey;
+		auto found = files.find(fileKey);
+		if (found != files.end())
+			return *found->second;
+
+		std::string source = ShaderPreprocessor::process(path, defines);
+		Shader& shader = stage(stageType, source.c_str(), ProgramCache::stageKey(ProgramCache::contentHash(source.data(), source.size()), stageType, definesKey));
+		files[fileKey] = &shader;
+		return shader;
+	}
+
+	Shader& stage(GLenum stageType, const EmbeddedShader& embedded, const ShaderDefines& defines = ShaderDefines()) {
+		if (ShaderPreprocessor::diskOverride || embedded.hasIncludes || !defines.empty())
+			return stage(stageType, std::string(embedded.name).c_str(), defines);
+		return stage(stageType, embedded.source.data(), ProgramCache::stageKey(embedded.hash, stageType));
+	}
+
+	// Deletes every stage program
+	void clear() {
+		for (auto& stage : stages)
+			glDeleteProgram(stage.second->ID);
+		stages.clear();
+		files.clear();
+	}
+
+private:
+	std::unordered_map<uint64_t, std::unique_ptr<Shader>> stages;
+	// Stage, path and defines of the files already built, so they aren't preprocessed again
+	std::unordered_map<std::string, Shader*> files;
+
+	Shader& stage(GLenum stageType, const char* source, uint64_t key) {
+		auto found = stages.find(key);
+		if (found != stages.end())
+			return *found->second;
+
+		unsigned int program = ProgramCache::load(key);
+		if (program == 0) {
+			program = linkSeparable(stageType, source);
+			if (program != 0)
+				ProgramCache::store(key, program);
+		}
+
+		std::unique_ptr<Shader>& stage = stages[key];
+		stage = std::make_unique<Shader>(program);
+		return *stage;
+	}
+
+	unsigned int linkSeparable(GLenum stageType, const char* source) {
+		linkCount++;
+
+		unsigned int shader = glCreateShader(stageType);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+
+		int success;
+		char infoLog[1024];
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (success == GL_FALSE) {
+			glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << (stageType == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << "::COMPILATION_FAILED\n" <<
+				infoLog << std::endl;
+			glDeleteShader(shader);
+			return 0;
+		}
+
+		unsigned int program = glCreateProgram();
+		// Must be set before linking, it allows the program to be used in a pipeline
+		glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glDetachShader(program, shader);
+		glDeleteShader(shader);
+
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (success == GL_FALSE) {
+			glGetProgramInfoLog(program, 1024, NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+};
+
+/*
+	A vertex stage and a fragment stage used together, works like a Shader:
+	use() it before drawing and set the uniforms with the same setters.
+	Each uniform is sent to the stage that declares it with glProgramUniform*,
+	so nothing has to be bound to set them.
+*/
+class ShaderPipeline {
+
+public:
+	// Program pipeline object ID
+	unsigned int ID;
+
+	ShaderPipeline(Shader& vertexStage, Shader& fragmentStage) : vertexStage(&vertexStage), fragmentStage(&fragmentStage) {
+		glGenProgramPipelines(1, &ID);
+		glUseProgramStages(ID, GL_VERTEX_SHADER_BIT, vertexStage.ID);
+		glUseProgramStages(ID, GL_FRAGMENT_SHADER_BIT, fragmentStage.ID);
+	}
+
+	void use() {
+		// A program bound with glUseProgram takes priority over the pipeline
+		GLState::useProgram(0);
+		GLState::bindProgramPipeline(ID);
+	}
+
+	void setBool(UniformHandle uniform, bool value) const {
+		forEachStage(uniform, [&](unsigned int program, int location) {
+			glProgramUniform1i(program, location, (int)value);
+		});
+	}
+
+	void setInt(UniformHandle uniform, int value) const {
+		forEachStage(uniform, [&](unsigned int program, int location) {
+			glProgramUniform1i(program, location, value);
+		});
+	}
+
+	void setFloat(UniformHandle uniform, float value) const {
+		forEachStage(uniform, [&](unsigned int program, int location) {
+			glProgramUniform1f(program, location, value);
+		});
+	}
+
+	void setMat4(UniformHandle uniform, GLboolean tranpose, const glm::mat4& matrix) const {
+		forEachStage(uniform, [&](unsigned int program, int location) {
+			glProgramUniformMatrix4fv(program, location, 1, tranpose, glm::value_ptr(matrix));
+		});
+	}
+
+	void setBool(const std::string& name, bool value) const {
+		setBool(UniformHandle(name.c_str()), value);
+	}
+
+	void setInt(const std::string& name, int value) const {
+		setInt(UniformHandle(name.c_str()), value);
+	}
+
+	void setFloat(const std::string& name, float value) const {
+		setFloat(UniformHandle(name.c_str()), value);
+	}
+
+	void setMat4(const std::string& name, GLboolean tranpose, const glm::mat4& matrix) const {
+		setMat4(UniformHandle(name.c_str()), tranpose, matrix);
+	}
+
+private:
+	Shader* vertexStage;
+	Shader* fragmentStage;
+
+	// Calls set(program, location) for every stage that declares the uniform
+	template <typename Setter>
+	void forEachStage(UniformHandle uniform, Setter set) const {
+		for (Shader* stage : { vertexStage, fragmentStage }) {
+			int location = stage->uniformLocation(uniform);
+			if (location != -1)
+				set(stage->ID, location);
+		}
+	}
+};
+
+#endif
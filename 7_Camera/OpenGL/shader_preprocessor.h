@@ -0,0 +1,183 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include <string>
+#include <map>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+
+#include "embedded_shader.h"
+#include "virtual_file_system.h"
+
+// #define NAME VALUE pairs injected into a shader, sorted so the same set always gives the same key
+typedef std::map<std::string, std::string> ShaderDefines;
+
+/*
+	GLSL has no #include, and the only way to make variants of a shader
+	is copying the file. This runs before the source goes to the driver:
+
+	#include "file.glsl" is replaced with the contents of the file (paths are
+	relative to the file including it, and each file is only included once).
+
+	The given defines are added right after the #version line, so the
+	source can use #ifdef / #if to turn features on and off.
+
+	#line directives are added around included files so compile errors still
+	point at the right line. The source string number is the index of the file
+	in the order they were included (0 is the main file).
+
+	Files are looked up first among the embedded shaders (if useEmbedded() was
+	called), then in the asset pack (if packFiles is set) and then on disk.
+	With diskOverride the disk comes first, so edited files are picked up
+	without rebuilding the embedded table or the pack.
+*/
+namespace ShaderPreprocessor {
+
+	inline const EmbeddedShader* embeddedFiles = nullptr;
+	inline size_t embeddedCount = 0;
+	inline bool diskOverride = false;
+	inline const VirtualFileSystem* packFiles = nullptr;
+
+	// e.g. ShaderPreprocessor::useEmbedded(EmbeddedShaders::all);
+	template <size_t N>
+	void useEmbedded(const EmbeddedShader (&files)[N]) {
+		embeddedFiles = files;
+		embeddedCount = N;
+	}
+
+	inline const EmbeddedShader* findEmbedded(const std::filesystem::path& path) {
+		std::string name = path.lexically_normal().generic_string();
+		for (size_t i = 0; i < embeddedCount; i++) {
+			if (embeddedFiles[i].name == name)
+				return &embeddedFiles[i];
+		}
+		return nullptr;
+	}
+
+	inline bool readDisk(const std::filesystem::path& path, std::string& contents) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		std::stringstream stream;
+		stream << file.rdbuf();
+		contents = stream.str();
+		return true;
+	}
+
+	inline bool readFile(const std::filesystem::path& path, std::string& contents) {
+		if (diskOverride && readDisk(path, contents))
+			return true;
+		if (const EmbeddedShader* embedded = findEmbedded(path)) {
+			contents.assign(embedded->source);
+			return true;
+		}
+		if (packFiles != nullptr) {
+			FileSpan packed = packFiles->find(path.generic_string());
+			if (!packed.empty()) {
+				contents.assign((const char*)packed.data, packed.size);
+				return true;
+			}
+		}
+		return !diskOverride && readDisk(path, contents);
+	}
+
+	// Canonical text of a define set, e.g. "MIX_AMOUNT=0.5;USE_MIX_UNIFORM=;"
+	inline std::string definesKey(const ShaderDefines& defines) {
+		std::string key;
+		for (const auto& define : defines)
+			key += define.first + "=" + define.second + ";";
+		return key;
+	}
+
+	inline bool expand(const std::filesystem::path& path, std::set<std::filesystem::path>& included, std::string& output) {
+		std::string source;
+		if (!readFile(path, source)) {
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFFULY_READ\n" << path.string() << std::endl;
+			return false;
+		}
+		int fileIndex = (int)included.size() - 1;
+
+		std::istringstream lines(source);
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(lines, line)) {
+			lineNumber++;
+
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+				output += line;
+				output += '\n';
+				continue;
+			}
+
+			size_t open = line.find('"', start + 8);
+			size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (close == std::string::npos) {
+				std::cout << "ERROR::SHADER::INCLUDE_SYNTAX\n" << path.string() << ":" << lineNumber << std::endl;
+				return false;
+			}
+
+			std::filesystem::path includePath = path.parent_path() / line.substr(open + 1, close - open - 1);
+			std::error_code error;
+			std::filesystem::path canonical = std::filesystem::weakly_canonical(includePath, error);
+			if (error)
+				canonical = includePath;
+
+			// Already included, behaves like #pragma once
+			if (!included.insert(canonical).second) {
+				output += '\n';
+				continue;
+			}
+
+			output += "#line 1 " + std::to_string(included.size() - 1) + "\n";
+			if (!expand(includePath, included, output))
+				return false;
+			// Back to the line after the #include in this file
+			output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+		}
+		return true;
+	}
+
+	/*
+		Returns the final source of the shader at path, or an empty string
+		if it (or any file it includes) couldn't be read.
+	*/
+	inline std::string process(const std::filesystem::path& path, const ShaderDefines& defines = ShaderDefines()) {
+		std::set<std::filesystem::path> included;
+		std::error_code error;
+		std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+		included.insert(error ? path : canonical);
+
+		std::string source;
+		if (!expand(path, included, source))
+			return std::string();
+
+		if (defines.empty())
+			return source;
+
+		// #version has to stay the first line, the defines go right after it
+		size_t insertAt = 0;
+		size_t version = source.find("#version");
+		if (version != std::string::npos) {
+			size_t end = source.find('\n', version);
+			insertAt = end == std::string::npos ? source.size() : end + 1;
+		}
+
+		std::string injected;
+		for (const auto& define : defines)
+			injected += "#define " + define.first + " " + define.second + "\n";
+		if (version != std::string::npos) {
+			int versionLine = 1;
+			for (size_t i = 0; i < version; i++)
+				versionLine += source[i] == '\n';
+			injected += "#line " + std::to_string(versionLine + 1) + " 0\n";
+		}
+
+		return source.insert(insertAt, injected);
+	}
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef SHADER_RELOADER_H
+#define SHADER_RELOADER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <filesystem>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "shader.h"
+#include "shader_compiler.h"
+
+/*
+	Hot-reload of shader programs.
+
+	The .vs/.fs files of every watched Shader are checked for changes
+	(inotify on Linux, comparing modification times elsewhere).
+	When one changes, the program is compiled and linked again on a
+	background thread with its own hidden GL context that shares objects
+	with the window's context, so the render loop never waits on the compiler.
+
+	Finished programs are only swapped in by swapReady(), which the
+	render loop calls between frames. If the new source doesn't compile
+	the old program is kept and the error is printed as usual.
+
+	Watched Shaders are referenced by pointer, so they must outlive the reloader.
+	Nothing is created until the first watch(): a reloader that never
+	watches anything costs no context and no thread.
+*/
+class ShaderReloader {
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct WatchedShader {
+		Shader* shader;
+		std::filesystem::path vertexPath;
+		std::filesystem::path fragmentPath;
+		std::function<void(Shader&)> setup;
+		ShaderDefines defines;
+		std::filesystem::file_time_type vertexTime{};
+		std::filesystem::file_time_type fragmentTime{};
+	};
+
+	struct ReadyProgram {
+		size_t watched;
+		unsigned int program;
+		Clock::time_point changed;
+	};
+
+public:
+	// Time between the file change being noticed and the new program being in use
+	double lastReloadMilliseconds = 0.0;
+	unsigned int reloadCount = 0;
+
+	explicit ShaderReloader(GLFWwindow* window) : mainWindow(window) {}
+
+	~ShaderReloader() {
+		stop();
+	}
+
+	/*
+		setup is called after every reload on the main thread, it should set
+		again the uniforms that are only set once (e.g. sampler texture units).
+		defines are the ones the program was built with, they're kept on reload.
+		Must be called from the main thread, the first call creates the hidden
+		context's window.
+	*/
+	void watch(Shader& shader, const char* vertexPath, const char* fragmentPath, std::function<void(Shader&)> setup = nullptr,
+		const ShaderDefines& defines = ShaderDefines()) {
+		if (!started)
+			start();
+		std::lock_guard<std::mutex> lock(watchedMutex);
+		WatchedShader watched{ &shader, vertexPath, fragmentPath, setup, defines };
+		std::error_code error;
+		watched.vertexTime = std::filesystem::last_write_time(watched.vertexPath, error);
+		watched.fragmentTime = std::filesystem::last_write_time(watched.fragmentPath, error);
+		watchedShaders.push_back(watched);
+		watchedChanged = true;
+	}
+
+	// Call once per frame, before drawing. Only swaps program IDs, never compiles.
+	void swapReady() {
+		std::vector<ReadyProgram> ready;
+		{
+			std::lock_guard<std::mutex> lock(readyMutex);
+			if (readyPrograms.empty())
+				return;
+			ready.swap(readyPrograms);
+		}
+
+		std::lock_guard<std::mutex> lock(watchedMutex);
+		for (const ReadyProgram& program : ready) {
+			WatchedShader& watched = watchedShaders[program.watched];
+			watched.shader->replaceProgram(program.program);
+			if (watched.setup)
+				watched.setup(*watched.shader);
+
+			lastReloadMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - program.changed).count();
+			reloadCount++;
+			std::cout << "Reloaded " << watched.vertexPath.string() << " + " << watched.fragmentPath.string() << " in " << lastReloadMilliseconds << " ms" << std::endl;
+		}
+	}
+
+	// Stops the background thread, call it before glfwTerminate()
+	void stop() {
+		if (worker.joinable()) {
+			running = false;
+			worker.join();
+		}
+		if (backgroundWindow != NULL) {
+			glfwDestroyWindow(backgroundWindow);
+			backgroundWindow = NULL;
+		}
+		// Programs compiled but never swapped in
+		for (const ReadyProgram& program : readyPrograms)
+			glDeleteProgram(program.program);
+		readyPrograms.clear();
+	}
+
+private:
+	GLFWwindow* mainWindow;
+	GLFWwindow* backgroundWindow = NULL;
+	bool started = false;
+	std::thread worker;
+	std::atomic<bool> running{ false };
+
+	std::mutex watchedMutex;
+	std::vector<WatchedShader> watchedShaders;
+	bool watchedChanged = false;
+
+	std::mutex readyMutex;
+	std::vector<ReadyProgram> readyPrograms;
+
+	void start() {
+		started = true;
+		// Hidden 1x1 window whose context shares objects with the main one,
+		// it keeps the context version hints set for the main window
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		backgroundWindow = glfwCreateWindow(1, 1, "", NULL, mainWindow);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+		if (backgroundWindow == NULL) {
+			std::cout << "ERROR::SHADER_RELOADER::BACKGROUND_CONTEXT_NOT_CREATED\n" << std::endl;
+			return;
+		}
+
+		running = true;
+		worker = std::thread(&ShaderReloader::run, this);
+	}
+
+	void run() {
+		glfwMakeContextCurrent(backgroundWindow);
+		ShaderCompiler compiler((GLADloadproc)glfwGetProcAddress);
+
+#ifdef __linux__
+		int notify = inotify_init1(IN_NONBLOCK);
+		std::vector<int> watches;
+#endif
+
+		while (running) {
+			std::vector<size_t> changed;
+			Clock::time_point noticed;
+
+#ifdef __linux__
+			if (notify >= 0) {
+				{
+					std::lock_guard<std::mutex> lock(watchedMutex);
+					if (watchedChanged) {
+						// Watch the directories, editors often save by replacing the file
+						for (int watch : watches)
+							inotify_rm_watch(notify, watch);
+						watches.clear();
+						for (const WatchedShader& watched : watchedShaders) {
+							for (const std::filesystem::path& path : { watched.vertexPath, watched.fragmentPath }) {
+								std::filesystem::path directory = path.parent_path().empty() ? "." : path.parent_path();
+								watches.push_back(inotify_add_watch(notify, directory.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE));
+							}
+						}
+						watchedChanged = false;
+					}
+				}
+
+				pollfd descriptor{ notify, POLLIN, 0 };
+				if (poll(&descriptor, 1, 100) <= 0)
+					continue;
+
+				// Drain the events, they only say "something changed", the
+				// modification times below decide which programs to rebuild
+				alignas(inotify_event) char buffer[4096];
+				while (read(notify, buffer, sizeof(buffer)) > 0) {}
+				noticed = Clock::now();
+				// Give the editor a moment to finish writing
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			}
+			else
+#endif
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(250));
+				noticed = Clock::now();
+			}
+
+			std::vector<std::pair<std::string, std::string>> sources;
+			std::vector<ShaderDefines> defines;
+			{
+				std::lock_guard<std::mutex> lock(watchedMutex);
+				for (size_t i = 0; i < watchedShaders.size(); i++) {
+					WatchedShader& watched = watchedShaders[i];
+					std::error_code error;
+					std::filesystem::file_time_type vertexTime = std::filesystem::last_write_time(watched.vertexPath, error);
+					std::filesystem::file_time_type fragmentTime = std::filesystem::last_write_time(watched.fragmentPath, error);
+					if (error || (vertexTime == watched.vertexTime && fragmentTime == watched.fragmentTime))
+						continue;
+					watched.vertexTime = vertexTime;
+					watched.fragmentTime = fragmentTime;
+					changed.push_back(i);
+					sources.push_back({ watched.vertexPath.string(), watched.fragmentPath.string() });
+					defines.push_back(watched.defines);
+				}
+			}
+
+			for (size_t i = 0; i < changed.size(); i++) {
+				unsigned int program = compiler.submitFiles(sources[i].first.c_str(), sources[i].second.c_str(), defines[i]).get();
+				compiler.poll(); // forget the finished program
+				if (program == 0)
+					continue; // keep the old program, the error was already printed
+
+				// The main context may only use the program once it's completely built
+				glFinish();
+
+				std::lock_guard<std::mutex> lock(readyMutex);
+				readyPrograms.push_back({ changed[i], program, noticed });
+			}
+		}
+
+#ifdef __linux__
+		if (notify >= 0)
+			close(notify);
+#endif
+		glfwMakeContextCurrent(NULL);
+	}
+};
+
+#endif
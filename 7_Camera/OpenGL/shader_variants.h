@@ -0,0 +1,163 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include "shader.h"
+#include "shader_compiler.h"
+#include "embedded_shader.h"
+#include "shader_preprocessor.h"
+#include "program_cache.h"
+
+/*
+	All the permutations of one .vs/.fs pair.
+
+	Instead of shipping a copy of the shader for every small difference,
+	the differences are #ifdef'd in one source and each combination of
+	defines is a variant. A variant is only compiled the first time it's
+	asked for, and then kept by the hash of its defines.
+
+	submit() queues a variant on a ShaderCompiler without waiting for it,
+	so the ones known to be needed compile while other things load and
+	get() only waits if it isn't done yet. common holds the defines every
+	variant gets (e.g. MaterialTable::defines()), they aren't part of the key.
+
+	onCompiled() is told about every variant once its program is in place,
+	e.g. to hand it to a ShaderReloader (see Source.cpp).
+*/
+class ShaderVariants {
+
+public:
+	ShaderDefines common;
+
+	ShaderVariants(const char* vertexPath, const char* fragmentPath, const ShaderDefines& common = ShaderDefines())
+		: common(common), vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+
+	// Variants of shaders embedded in the executable (embedded_shaders.h)
+	ShaderVariants(const EmbeddedShader& vertex, const EmbeddedShader& fragment, const ShaderDefines& common = ShaderDefines())
+		: common(common), vertexPath(vertex.name), fragmentPath(fragment.name), vertexEmbedded(&vertex), fragmentEmbedded(&fragment) {}
+
+	ShaderVariants(const ShaderVariants&) = delete;
+	ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+	// Hash of a define set, can be computed once and reused with find()
+	static uint64_t variantKey(const ShaderDefines& defines) {
+		return ProgramCache::hashString(14695981039346656037ull, ShaderPreprocessor::definesKey(defines));
+	}
+
+	// Everything a variant is built with: common plus its own defines (which win)
+	ShaderDefines definesFor(const ShaderDefines& defines) const {
+		ShaderDefines result = defines;
+		result.insert(common.begin(), common.end());
+		return result;
+	}
+
+	/*
+		Queues the variant on the compiler, get() or find() picks it up later.
+		Returns an empty future if the variant was already asked for.
+	*/
+	/*
+		Calls compiled for every variant whose program is in place, and then
+		for each one that gets its program later. It gets the files and the
+		full defines the variant was built with.
+	*/
+	void onCompiled(std::function<void(Shader&, const char* vertexPath, const char* fragmentPath, const ShaderDefines&)> compiled) {
+		this->compiled = compiled;
+		for (auto& variant : variants)
+			if (!variant.second.pending.valid())
+				notify(variant.second);
+	}
+
+	ShaderCompiler::ProgramFuture submit(ShaderCompiler& compiler, const ShaderDefines& defines = ShaderDefines()) {
+		uint64_t key = variantKey(defines);
+		if (variants.find(key) != variants.end())
+			return ShaderCompiler::ProgramFuture();
+
+		Variant& variant = variants[key];
+		variant.shader = std::make_unique<Shader>(0u);
+		variant.defines = definesFor(defines);
+		if (vertexEmbedded != nullptr)
+			variant.pending = compiler.submit(*vertexEmbedded, *fragmentEmbedded, variant.defines);
+		else
+			variant.pending = compiler.submitFiles(vertexPath.c_str(), fragmentPath.c_str(), variant.defines);
+		return variant.pending;
+	}
+
+	// Returns the variant for these defines, compiling it (or waiting for it) if needed
+	Shader& get(const ShaderDefines& defines = ShaderDefines()) {
+		uint64_t key = variantKey(defines);
+		auto found = variants.find(key);
+		if (found != variants.end()) {
+			finish(found->second);
+			return *found->second.shader;
+		}
+
+		Variant& variant = variants[key];
+		variant.defines = definesFor(defines);
+		if (vertexEmbedded != nullptr)
+			variant.shader = std::make_unique<Shader>(*vertexEmbedded, *fragmentEmbedded, variant.defines);
+		else
+			variant.shader = std::make_unique<Shader>(vertexPath.c_str(), fragmentPath.c_str(), variant.defines);
+		notify(variant);
+		return *variant.shader;
+	}
+
+	// Variant with this key if it's compiled, nullptr if it wasn't asked for or is still compiling
+	Shader* find(uint64_t key) {
+		auto found = variants.find(key);
+		if (found == variants.end())
+			return nullptr;
+		Variant& variant = found->second;
+		if (variant.pending.valid() && !variant.pending.ready())
+			return nullptr;
+		finish(variant);
+		return variant.shader.get();
+	}
+
+	size_t compiledCount() const {
+		return variants.size();
+	}
+
+	// Deletes every program compiled so far, whoever onCompiled() gave them to must forget them first
+	void clear() {
+		for (auto& variant : variants) {
+			finish(variant.second);
+			// Through the Shader, so GLState and CameraBlock forget it too
+			variant.second.shader->replaceProgram(0);
+		}
+		variants.clear();
+	}
+
+private:
+	struct Variant {
+		std::unique_ptr<Shader> shader;
+		ShaderDefines defines;
+		// Valid until the submitted program is picked up
+		ShaderCompiler::ProgramFuture pending;
+	};
+
+	std::string vertexPath;
+	std::string fragmentPath;
+	const EmbeddedShader* vertexEmbedded = nullptr;
+	const EmbeddedShader* fragmentEmbedded = nullptr;
+	std::unordered_map<uint64_t, Variant> variants;
+	std::function<void(Shader&, const char*, const char*, const ShaderDefines&)> compiled;
+
+	void finish(Variant& variant) {
+		if (!variant.pending.valid())
+			return;
+		variant.shader->replaceProgram(variant.pending.get());
+		variant.pending = ShaderCompiler::ProgramFuture();
+		notify(variant);
+	}
+
+	void notify(Variant& variant) {
+		if (compiled)
+			compiled(*variant.shader, vertexPath.c_str(), fragmentPath.c_str(), variant.defines);
+	}
+};
+
+#endif
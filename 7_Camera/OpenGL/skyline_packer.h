@@ -0,0 +1,103 @@
+#ifndef SKYLINE_PACKER_H
+#define SKYLINE_PACKER_H
+
+#include <vector>
+#include <cstddef>
+
+/*
+	Packs rectangles into a fixed size area (e.g. an atlas texture),
+	no OpenGL here.
+
+	The area is filled from the bottom up, and the top edge of what has
+	been placed so far is kept as a "skyline": a list of horizontal
+	segments. A new rectangle goes where it rests lowest on the skyline
+	(and leftmost on ties), then the skyline is raised under it. Gaps
+	below the skyline are never reused, which wastes a little space but
+	keeps inserting fast. Inserting the tallest rectangles first packs best.
+*/
+class SkylinePacker {
+
+public:
+	int width, height;
+
+	SkylinePacker(int width, int height) : width(width), height(height) {
+		skyline.push_back({ 0, 0, width });
+	}
+
+	// Finds room for a w x h rectangle, returns false if it doesn't fit anywhere
+	bool insert(int w, int h, int& x, int& y) {
+		int bestY = height, bestWidth = width + 1;
+		size_t bestIndex = skyline.size();
+		for (size_t i = 0; i < skyline.size(); i++) {
+			int restY = fit(i, w, h);
+			// Lowest first, then the narrowest segment so wide ones stay free
+			if (restY >= 0 && (restY < bestY || (restY == bestY && skyline[i].width < bestWidth))) {
+				bestY = restY;
+				bestWidth = skyline[i].width;
+				bestIndex = i;
+			}
+		}
+		if (bestIndex == skyline.size())
+			return false;
+
+		x = skyline[bestIndex].x;
+		y = bestY;
+		raise(bestIndex, x, y + h, w);
+		usedArea += (size_t)w * h;
+		return true;
+	}
+
+	// Fraction of the area covered by rectangles
+	float occupancy() const {
+		return (float)usedArea / ((float)width * height);
+	}
+
+private:
+	struct Segment {
+		int x, y, width;
+	};
+	std::vector<Segment> skyline;
+	size_t usedArea = 0;
+
+	// y a rectangle starting at segment index rests on, -1 if it goes out of the area
+	int fit(size_t index, int w, int h) const {
+		int x = skyline[index].x;
+		if (x + w > width)
+			return -1;
+		int y = 0;
+		for (size_t i = index; i < skyline.size() && skyline[i].x < x + w; i++) {
+			if (skyline[i].y > y)
+				y = skyline[i].y;
+		}
+		return y + h <= height ? y : -1;
+	}
+
+	// New segment on top of the rectangle, replacing the ones it covers
+	void raise(size_t index, int x, int top, int w) {
+		skyline.insert(skyline.begin() + index, { x, top, w });
+		size_t i = index + 1;
+		while (i < skyline.size() && skyline[i].x < x + w) {
+			int end = skyline[i].x + skyline[i].width;
+			if (end <= x + w)
+				skyline.erase(skyline.begin() + i);
+			else {
+				// Partly covered, keep what sticks out on the right
+				skyline[i].width = end - (x + w);
+				skyline[i].x = x + w;
+				break;
+			}
+		}
+
+		// Neighbours at the same height become one segment
+		for (size_t j = 0; j + 1 < skyline.size();) {
+			if (skyline[j].y == skyline[j + 1].y) {
+				skyline[j].width += skyline[j + 1].width;
+				skyline.erase(skyline.begin() + j + 1);
+			}
+			else
+				j++;
+		}
+	}
+};
+
+#endif
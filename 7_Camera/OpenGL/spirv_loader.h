@@ -0,0 +1,117 @@
+#ifndef SPIRV_LOADER_H
+#define SPIRV_LOADER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+/*
+	Loads shaders precompiled to SPIR-V by Tools/ShaderSpirv (GL_ARB_gl_spirv, core in 4.6).
+
+	The GLSL was already parsed and validated when the tool ran, so the driver
+	skips its GLSL front end: glShaderBinary hands it the SPIR-V module and
+	glSpecializeShader picks the entry point, which is where it gets compiled.
+
+	SPIR-V has no uniform names, so the tool also writes a .uniforms file
+	with the "location name" of every layout(location = N) uniform, which
+	is given to Shader::addUniformLocations so the setters keep working.
+*/
+namespace SpirvLoader {
+
+	// The driver must list SPIR-V among the binary formats glShaderBinary accepts
+	inline bool supported() {
+		int count = 0;
+		glGetIntegerv(GL_NUM_SHADER_BINARY_FORMATS, &count);
+		if (count <= 0)
+			return false;
+		std::vector<int> formats(count);
+		glGetIntegerv(GL_SHADER_BINARY_FORMATS, formats.data());
+		for (int format : formats) {
+			if (format == GL_SHADER_BINARY_FORMAT_SPIR_V)
+				return true;
+		}
+		return false;
+	}
+
+	inline bool readBinary(const std::string& path, std::vector<char>& contents) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+		contents.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(contents.data(), contents.size());
+		return (bool)file && !contents.empty();
+	}
+
+	// Returns a compiled shader object, or 0 if the module is missing or was rejected
+	inline unsigned int loadShader(GLenum shaderType, const std::string& path) {
+		std::vector<char> module;
+		if (!readBinary(path, module))
+			return 0;
+
+		unsigned int id = glCreateShader(shaderType);
+		glShaderBinary(1, &id, GL_SHADER_BINARY_FORMAT_SPIR_V, module.data(), (GLsizei)module.size());
+		// Entry point "main", no specialization constants
+		glSpecializeShader(id, "main", 0, NULL, NULL);
+
+		int success;
+		char infoLog[1024];
+		glGetShaderiv(id, GL_COMPILE_STATUS, &success);
+		if (success == GL_FALSE) {
+			glGetShaderInfoLog(id, 1024, NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << (shaderType == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << "::SPIRV_SPECIALIZATION_FAILED\n" <<
+				infoLog << std::endl;
+			glDeleteShader(id);
+			return 0;
+		}
+		return id;
+	}
+
+	// Linked program from two SPIR-V modules, or 0 so the caller can fall back to GLSL
+	inline unsigned int loadProgram(const std::string& vertexPath, const std::string& fragmentPath) {
+		unsigned int vertexShader = loadShader(GL_VERTEX_SHADER, vertexPath);
+		if (vertexShader == 0)
+			return 0;
+		unsigned int fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentPath);
+		if (fragmentShader == 0) {
+			glDeleteShader(vertexShader);
+			return 0;
+		}
+
+		unsigned int program = glCreateProgram();
+		glAttachShader(program, vertexShader);
+		glAttachShader(program, fragmentShader);
+		glLinkProgram(program);
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+
+		int success;
+		char infoLog[1024];
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (success == GL_FALSE) {
+			glGetProgramInfoLog(program, 1024, NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	// "location name" lines written by Tools/ShaderSpirv
+	inline std::vector<std::pair<std::string, int>> readUniforms(const std::string& path) {
+		std::vector<std::pair<std::string, int>> uniforms;
+		std::ifstream file(path);
+		int location;
+		std::string name;
+		while (file >> location >> name)
+			uniforms.push_back({ name, location });
+		return uniforms;
+	}
+}
+
+#endif
@@ -0,0 +1,518 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb/stb_image.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+
+#include "thread_pool.h"
+#include "gl_state.h"
+#include "pixel_upload_ring.h"
+#include "ktx2_loader.h"
+#include "mip_generator.h"
+#include "virtual_file_system.h"
+#include "image_arena.h"
+
+typedef unsigned int TextureHandle;
+
+// What a loaded texture looks like on the GPU
+struct TextureInfo {
+	int width = 0, height = 0;
+	int levels = 0;
+	// Sized format, as glTexStorage2D wants it
+	GLenum internalFormat = 0;
+	// Estimated GPU memory of every level
+	size_t bytes = 0;
+	// Top levels removed by dropTopMip()
+	int droppedMips = 0;
+};
+
+/*
+	Loads textures without stopping the GL thread.
+
+	Decoding a jpg/png with stbi_load is the slow part and doesn't need the
+	GL context, so it runs on a pool of worker threads. Decoded images wait
+	in a queue until uploadPending() is called on the GL thread, which only
+	uploads as many as fit in the time budget it's given (e.g. a couple of
+	milliseconds per frame), so loading many textures never causes a long frame.
+
+	load() returns a handle right away. Until the texture is uploaded,
+	id() gives a 1x1 white placeholder texture, so the handle can be bound
+	and drawn with from the first frame.
+
+	The workers copy the decoded pixels into a persistently mapped
+	PixelUploadRing, so the upload is a glTexSubImage2D from an offset in
+	that buffer, which returns without the driver copying the pixels again.
+	Images too big for the ring are uploaded from client memory as before.
+
+	.ktx2 files cooked by Tools/TextureCooker skip all of that: the worker
+	only maps the file, and the upload copies the stored mip levels as they are.
+
+	Each worker decodes in its own ImageArena (see image.cpp), so
+	stb_image's buffers come from memory the thread already owns instead of
+	the global heap. The pixels are always copied out of the arena before
+	it's reset, into the ring or the expanded buffer.
+
+	When files is set to a mounted asset pack, the paths found in it are
+	read from the pack's mapping (stbi_load_from_memory, or the .ktx2
+	levels in place) and the others from disk as before.
+
+	The mip levels are built on the worker too (MipGenerator, Kaiser filter,
+	in linear light for sRGB textures) and uploaded with the image, so no
+	glGenerateMipmap runs on the GL thread. Set cpuMipmaps to false to go
+	back to glGenerateMipmap.
+
+	Textures are immutable (glTexStorage2D) with a sized format picked from
+	the image's channels. 3 channel images are widened to RGBA on the worker
+	while copying into the ring: RGB8 isn't a format GPUs store, so uploading
+	RGB makes the driver convert every pixel on the GL thread.
+*/
+class TextureLoader {
+
+	struct DecodedImage {
+		TextureHandle handle;
+		// Generation of the handle when the decode started, see release()
+		unsigned int generation;
+		// stb_image's buffer, or NULL when the pixels are in the ring
+		unsigned char* data;
+		PixelUploadRing::Allocation staging;
+		// RGB rows widened to RGBA, when they couldn't go in the ring
+		std::vector<unsigned char> expanded;
+		// Channels after widening
+		int width, height, nrChannels;
+		bool srgb;
+		// The pixels are followed by every other mip level
+		bool hasMips;
+		// Set instead of the pixels for cooked .ktx2 files
+		std::shared_ptr<Ktx2Texture> cooked;
+	};
+
+public:
+	// Textures uploaded so far
+	unsigned int uploadedCount = 0;
+
+	// Mip levels built on the workers instead of with glGenerateMipmap
+	bool cpuMipmaps = true;
+	MipGenerator::Filter mipFilter = MipGenerator::FILTER_KAISER;
+
+	// stb_image allocates from the workers' arenas instead of malloc
+	bool arenaDecoding = true;
+
+	// Asset pack looked in before the disk, set before the first load()
+	const VirtualFileSystem* files = nullptr;
+
+	// 0 threads means one per core, 0 ring bytes uploads everything from client memory
+	explicit TextureLoader(unsigned int threads = 0, size_t ringBytes = 64 * 1024 * 1024) : pool(threads) {
+		if (ringBytes > 0)
+			ring.reset(new PixelUploadRing(ringBytes));
+
+		// Placeholder shown until the real texture arrives
+		unsigned char white[4] = { 255, 255, 255, 255 };
+		glGenTextures(1, &placeholder);
+		GLState::bindTexture(0, GL_TEXTURE_2D, placeholder);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	// Starts decoding the image on a worker thread, never blocks
+	// srgb is for color images, the GPU converts them to linear when sampling
+	TextureHandle load(const std::string& path, bool flipVertically = true, bool srgb = false) {
+		TextureHandle handle;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// Slots of released handles are reused before the arrays grow
+			if (!freeHandles.empty()) {
+				handle = freeHandles.back();
+				freeHandles.pop_back();
+			}
+			else {
+				handle = (TextureHandle)textures.size();
+				textures.push_back(0);
+				infos.push_back(TextureInfo());
+				generations.push_back(0);
+			}
+		}
+		decode(handle, path, flipVertically, srgb);
+		return handle;
+	}
+
+	/*
+		Loads the image again into an existing handle (e.g. to bring back
+		dropped mips). The current texture stays in use until the new one
+		is uploaded and replaces it.
+	*/
+	void reload(TextureHandle handle, const std::string& path, bool flipVertically = true, bool srgb = false) {
+		if (handle < textures.size())
+			decode(handle, path, flipVertically, srgb);
+	}
+
+	// Deletes the texture, the handle gives the placeholder until it's reloaded
+	void unload(TextureHandle handle) {
+		if (handle >= textures.size() || textures[handle] == 0)
+			return;
+		GLState::deleteTextures(1, &textures[handle]);
+		textures[handle] = 0;
+		infos[handle] = TextureInfo();
+	}
+
+	/*
+		Deletes the texture and gives the handle back, a later load() may
+		return it again for another texture, so it must not be used anymore.
+		A decode of it still running is thrown away instead of uploaded.
+	*/
+	void release(TextureHandle handle) {
+		if (handle >= textures.size())
+			return;
+		unload(handle);
+		std::lock_guard<std::mutex> lock(mutex);
+		generations[handle]++;
+		freeHandles.push_back(handle);
+	}
+
+	/*
+		Frees the largest mip level: the texture is replaced by one half its
+		size holding the other levels, copied on the GPU with glCopyImageSubData.
+		Returns false if there's no level to drop.
+	*/
+	bool dropTopMip(TextureHandle handle) {
+		if (handle >= textures.size() || textures[handle] == 0 || infos[handle].levels <= 1)
+			return false;
+		TextureInfo& info = infos[handle];
+		unsigned int old = textures[handle];
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		GLState::bindTexture(0, GL_TEXTURE_2D, texture);
+		setSampling(info.levels - 1);
+		glTexStorage2D(GL_TEXTURE_2D, info.levels - 1, info.internalFormat, std::max(1, info.width / 2), std::max(1, info.height / 2));
+		for (int level = 1; level < info.levels; level++) {
+			glCopyImageSubData(old, GL_TEXTURE_2D, level, 0, 0, 0, texture, GL_TEXTURE_2D, level - 1, 0, 0, 0,
+				std::max(1, info.width >> level), std::max(1, info.height >> level), 1);
+		}
+		GLState::deleteTextures(1, &old);
+
+		textures[handle] = texture;
+		info.width = std::max(1, info.width / 2);
+		info.height = std::max(1, info.height / 2);
+		info.levels--;
+		info.droppedMips++;
+		info.bytes = estimateBytes(info.internalFormat, info.width, info.height, info.levels);
+		return true;
+	}
+
+	const TextureInfo& info(TextureHandle handle) const {
+		static const TextureInfo none;
+		return handle < infos.size() ? infos[handle] : none;
+	}
+
+	// RGB -> RGBA with opaque alpha
+	static void expandToRgba(const unsigned char* rgb, unsigned char* rgba, size_t pixels) {
+		for (size_t i = 0; i < pixels; i++) {
+			rgba[i * 4 + 0] = rgb[i * 3 + 0];
+			rgba[i * 4 + 1] = rgb[i * 3 + 1];
+			rgba[i * 4 + 2] = rgb[i * 3 + 2];
+			rgba[i * 4 + 3] = 255;
+		}
+	}
+
+	/*
+		Sized format for the channels: 8 bits each, sRGB only exists for
+		color (RGBA) formats. The pixels are always given in this same
+		layout, so the driver copies them without any conversion.
+	*/
+	static GLenum sizedFormat(int nrChannels, bool srgb) {
+		if (nrChannels == 4)
+			return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+		return nrChannels == 2 ? GL_RG8 : GL_R8;
+	}
+
+	// Rough GPU memory of a texture with its mips, drivers may pad or align it differently
+	static size_t estimateBytes(GLenum internalFormat, int width, int height, int levels) {
+		size_t bytes = 0;
+		for (int level = 0; level < levels; level++) {
+			size_t w = std::max(1, width >> level), h = std::max(1, height >> level);
+			switch (internalFormat) {
+			case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+				bytes += ((w + 3) / 4) * ((h + 3) / 4) * 8;
+				break;
+			case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			case GL_COMPRESSED_RGBA_BPTC_UNORM: case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+				bytes += ((w + 3) / 4) * ((h + 3) / 4) * 16;
+				break;
+			case GL_R8:
+				bytes += w * h;
+				break;
+			case GL_RG8:
+				bytes += w * h * 2;
+				break;
+			default:
+				// RGBA8 and SRGB8_ALPHA8 (RGB8 is usually padded to 4 bytes too)
+				bytes += w * h * 4;
+				break;
+			}
+		}
+		return bytes;
+	}
+
+private:
+	void decode(TextureHandle handle, const std::string& path, bool flipVertically, bool srgb) {
+		unsigned int generation;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending++;
+			generation = generations[handle];
+		}
+
+		pool.submit([this, handle, generation, path, flipVertically, srgb] {
+			DecodedImage image = { handle, generation, NULL, {}, {}, 0, 0, 0, srgb, false, nullptr };
+			FileSpan packed = files != nullptr ? files->find(path) : FileSpan();
+			if (isCooked(path)) {
+				std::shared_ptr<Ktx2Texture> cooked = std::make_shared<Ktx2Texture>();
+				if (packed.empty() ? cooked->open(path) : cooked->open(packed.data, packed.size, path))
+					image.cooked = cooked;
+				std::lock_guard<std::mutex> lock(mutex);
+				decoded.push_back(std::move(image));
+				return;
+			}
+
+			// Everything stb_image allocates from here on is dropped at once at the end of the task
+			ImageArena::Scope arena(arenaDecoding);
+			// The flip setting is per thread, so workers don't affect each other
+			stbi_set_flip_vertically_on_load_thread(flipVertically);
+			int fileChannels = 0;
+			if (packed.empty())
+				image.data = stbi_load(path.c_str(), &image.width, &image.height, &fileChannels, 0);
+			else
+				image.data = stbi_load_from_memory(packed.data, (int)packed.size, &image.width, &image.height, &fileChannels, 0);
+			if (!image.data)
+				std::cout << "Failed to load texture " << path << std::endl;
+			else {
+				image.nrChannels = fileChannels == 3 ? 4 : fileChannels;
+				size_t pixels = (size_t)image.width * image.height;
+				size_t levelSize = pixels * image.nrChannels;
+				bool mips = cpuMipmaps;
+				size_t size = levelSize + (mips ? MipGenerator::chainSize(image.width, image.height, image.nrChannels) : 0);
+
+				// May wait here until the GL thread retires older uploads
+				if (ring && ring->valid())
+					image.staging = ring->allocate(size);
+
+				unsigned char* destination = image.staging.pointer;
+				// stb_image's buffer can only be kept for the upload if it isn't in the arena
+				if (destination == nullptr && (fileChannels != image.nrChannels || mips || arenaDecoding)) {
+					image.expanded.resize(size);
+					destination = image.expanded.data();
+				}
+				if (destination != nullptr) {
+					if (fileChannels != image.nrChannels)
+						expandToRgba(image.data, destination, pixels);
+					else
+						std::memcpy(destination, image.data, levelSize);
+
+					// Filtered from stb_image's buffer, the ring is write-combined memory and slow to read
+					if (mips) {
+						MipGenerator::Options options;
+						options.filter = mipFilter;
+						options.srgb = srgb;
+						MipGenerator::generate(image.data, image.width, image.height, fileChannels,
+							destination + levelSize, image.nrChannels, options, &pool);
+						image.hasMips = true;
+					}
+					stbi_image_free(image.data);
+					image.data = NULL;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.push_back(std::move(image));
+		});
+	}
+
+public:
+	// GL texture to bind for the handle, the placeholder if it isn't uploaded yet
+	unsigned int id(TextureHandle handle) const {
+		unsigned int texture = handle < textures.size() ? textures[handle] : 0;
+		return texture != 0 ? texture : placeholder;
+	}
+
+	bool ready(TextureHandle handle) const {
+		return handle < textures.size() && textures[handle] != 0;
+	}
+
+	// Images not uploaded yet
+	size_t pendingCount() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return pending;
+	}
+
+	/*
+		Uploads decoded images until budgetMilliseconds is used up, call it
+		once per frame on the GL thread. At least one image is uploaded per
+		call, so loading always moves forward. Returns how many were uploaded.
+	*/
+	unsigned int uploadPending(double budgetMilliseconds) {
+		auto start = std::chrono::steady_clock::now();
+		unsigned int uploaded = 0;
+		// Frees ring space the GPU has finished reading, for the workers waiting on it
+		if (ring)
+			ring->retire();
+
+		for (;;) {
+			DecodedImage image;
+			bool released;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (decoded.empty())
+					break;
+				image = std::move(decoded.front());
+				decoded.pop_front();
+				pending--;
+				released = image.generation != generations[image.handle];
+			}
+
+			if (released) {
+				// The handle was released (and maybe reused) while this was decoding
+				if (image.staging.pointer)
+					ring->cancel(image.staging);
+			}
+			else if (image.data || image.staging.pointer || !image.expanded.empty() || image.cooked) {
+				TextureInfo info;
+				unsigned int texture = image.cooked ? uploadCooked(*image.cooked, info) : upload(image, info);
+				if (texture != 0) {
+					// A reload replaces the texture it had
+					unload(image.handle);
+					std::lock_guard<std::mutex> lock(mutex);
+					textures[image.handle] = texture;
+					infos[image.handle] = info;
+				}
+			}
+			stbi_image_free(image.data);
+			uploaded++;
+			uploadedCount++;
+
+			double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (elapsed >= budgetMilliseconds)
+				break;
+		}
+		return uploaded;
+	}
+
+	/*
+		Blocks until every requested texture is decoded and uploaded.
+		It can't just wait for the pool: a worker may be waiting for ring
+		space, which is only freed by uploading and retiring on this thread.
+	*/
+	void finishAll() {
+		while (pendingCount() > 0) {
+			if (uploadPending(1e30) == 0)
+				std::this_thread::yield();
+		}
+		pool.wait();
+	}
+
+	// Deletes every texture and the ring, call it before glfwTerminate()
+	void deleteTextures() {
+		finishAll();
+		if (ring)
+			ring->destroy();
+		for (unsigned int& texture : textures) {
+			if (texture != 0)
+				GLState::deleteTextures(1, &texture);
+			texture = 0;
+		}
+		GLState::deleteTextures(1, &placeholder);
+		placeholder = 0;
+	}
+
+private:
+	ThreadPool pool;
+	std::unique_ptr<PixelUploadRing> ring;
+	std::mutex mutex;
+	std::deque<DecodedImage> decoded;
+	std::vector<unsigned int> textures;
+	std::vector<TextureInfo> infos;
+	// Bumped by release(), so decodes started before it are dropped
+	std::vector<unsigned int> generations;
+	std::vector<TextureHandle> freeHandles;
+	size_t pending = 0;
+	unsigned int placeholder = 0;
+
+	static bool isCooked(const std::string& path) {
+		return path.size() >= 5 && path.compare(path.size() - 5, 5, ".ktx2") == 0;
+	}
+
+	// Texture wrapping and filtering of the bound texture
+	static void setSampling(int levels) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	unsigned int uploadCooked(const Ktx2Texture& cooked, TextureInfo& info) {
+		unsigned int texture = cooked.upload();
+		info.width = cooked.width;
+		info.height = cooked.height;
+		info.levels = cooked.levelCount;
+		info.internalFormat = Ktx2Texture::internalFormat(cooked.format);
+		info.bytes = estimateBytes(info.internalFormat, info.width, info.height, info.levels);
+		return texture;
+	}
+
+	unsigned int upload(const DecodedImage& image, TextureInfo& info) {
+		info.width = image.width;
+		info.height = image.height;
+		info.levels = (int)Ktx2::mipCount(image.width, image.height);
+		info.internalFormat = sizedFormat(image.nrChannels, image.srgb);
+		info.bytes = estimateBytes(info.internalFormat, info.width, info.height, info.levels);
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		GLState::bindTexture(0, GL_TEXTURE_2D, texture);
+		setSampling(info.levels);
+		// Every level allocated once with its final format, the driver never has to reallocate it
+		glTexStorage2D(GL_TEXTURE_2D, info.levels, info.internalFormat, image.width, image.height);
+
+		GLenum format = image.nrChannels == 4 ? GL_RGBA : image.nrChannels == 2 ? GL_RG : GL_RED;
+		// Rows of 2 or 1 byte pixels aren't always 4 byte aligned
+		if (image.nrChannels != 4)
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		// With the ring bound, the pixel pointer is an offset into it
+		const unsigned char* pixels = image.staging.pointer ? (const unsigned char*)image.staging.offset
+			: image.expanded.empty() ? image.data : image.expanded.data();
+		if (image.staging.pointer)
+			ring->bind();
+
+		int levels = image.hasMips ? info.levels : 1;
+		for (int level = 0; level < levels; level++) {
+			int width = std::max(1, image.width >> level), height = std::max(1, image.height >> level);
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+			pixels += (size_t)width * height * image.nrChannels;
+		}
+
+		if (image.staging.pointer) {
+			ring->unbind();
+			// Fenced after the upload, the region is reused once the GPU has read it
+			ring->submit(image.staging);
+		}
+		if (image.nrChannels != 4)
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		if (!image.hasMips)
+			glGenerateMipmap(GL_TEXTURE_2D);
+		return texture;
+	}
+};
+
+#endif
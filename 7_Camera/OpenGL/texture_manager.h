@@ -0,0 +1,266 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#include "texture_loader.h"
+#include "mapped_file.h"
+#include "program_cache.h"
+
+class TextureManager;
+
+// Bookkeeping of one texture of a TextureManager
+struct TextureEntry {
+	uint64_t key;
+	std::string path;
+	bool flipVertically;
+	bool srgb;
+	TextureHandle handle;
+	unsigned int refCount = 0;
+	uint64_t lastUsedFrame = 0;
+	// Memory with every mip level, known once it's uploaded
+	size_t fullBytes = 0;
+	bool restoring = false;
+};
+
+/*
+	Counted reference to a texture of a TextureManager. Copying it shares
+	the texture, and when the last copy is gone the texture may be freed
+	(it stays cached until the memory budget needs the space).
+*/
+class TextureRef {
+
+public:
+	TextureRef() {}
+	TextureRef(const TextureRef& other);
+	TextureRef& operator=(const TextureRef& other);
+	~TextureRef();
+
+	bool valid() const {
+		return entry != nullptr;
+	}
+
+private:
+	friend class TextureManager;
+	TextureEntry* entry = nullptr;
+	TextureManager* manager = nullptr;
+};
+
+/*
+	Owns every texture of the scene, so each image is only loaded once.
+
+	Textures are keyed by the hash of the file contents, not its path,
+	so the same image copied in different directories (like every lesson's
+	container.jpg) is one texture. acquire() hands out counted TextureRefs.
+
+	Each texture's GPU memory is estimated, and endFrame() keeps the total
+	under budgetBytes: first unreferenced textures are deleted, least
+	recently used first, then textures not drawn this frame lose their
+	largest mip levels (half the size each time, a quarter of the memory).
+	A texture with dropped mips is loaded again in full when it's used and
+	the budget has room for it.
+*/
+class TextureManager {
+
+	typedef TextureEntry Entry;
+	friend class TextureRef;
+
+public:
+	size_t budgetBytes;
+	// Estimated GPU memory of every texture, as of the last endFrame()
+	size_t residentBytes = 0;
+
+	struct Stats {
+		unsigned int sharedLoads = 0;	// acquire() calls that found the texture already loaded
+		unsigned int evictions = 0;
+		unsigned int mipsDropped = 0;
+		unsigned int mipsRestored = 0;
+	} stats;
+
+	// Textures won't lose mips below this size
+	int minimumSize = 64;
+
+	TextureManager(TextureLoader& loader, size_t budgetBytes) : budgetBytes(budgetBytes), loader(loader) {}
+
+	TextureManager(const TextureManager&) = delete;
+	TextureManager& operator=(const TextureManager&) = delete;
+
+	TextureRef acquire(const std::string& path, bool flipVertically = true, bool srgb = false) {
+		uint64_t key = keyOf(path, flipVertically, srgb);
+		auto found = entries.find(key);
+		if (found == entries.end()) {
+			Entry entry;
+			entry.key = key;
+			entry.path = path;
+			entry.flipVertically = flipVertically;
+			entry.srgb = srgb;
+			entry.handle = loader.load(path, flipVertically, srgb);
+			found = entries.emplace(key, entry).first;
+		}
+		else {
+			stats.sharedLoads++;
+		}
+
+		TextureRef ref;
+		ref.manager = this;
+		ref.entry = &found->second;
+		retain(ref);
+		return ref;
+	}
+
+	// GL texture to bind, also marks it as used this frame
+	unsigned int id(const TextureRef& ref) {
+		Entry* entry = get(ref);
+		if (entry == nullptr)
+			return loader.id((TextureHandle)-1);
+		entry->lastUsedFrame = frame;
+
+		const TextureInfo& info = loader.info(entry->handle);
+		if (info.droppedMips > 0 && !entry->restoring && residentBytes + entry->fullBytes <= budgetBytes + info.bytes) {
+			// It's needed again and fits: load it back with every level
+			loader.reload(entry->handle, entry->path, entry->flipVertically, entry->srgb);
+			entry->restoring = true;
+			stats.mipsRestored++;
+		}
+		return loader.id(entry->handle);
+	}
+
+	// Size and format of the texture as it's loaded now, all zero until it's uploaded
+	const TextureInfo& info(const TextureRef& ref) const {
+		return loader.info(ref.entry != nullptr ? ref.entry->handle : (TextureHandle)-1);
+	}
+
+	size_t textureCount() const {
+		return entries.size();
+	}
+
+	// Applies the budget, call it once per frame after drawing
+	void endFrame() {
+		residentBytes = 0;
+		std::vector<Entry*> idle;
+		for (auto& pair : entries) {
+			Entry& entry = pair.second;
+			const TextureInfo& info = loader.info(entry.handle);
+			if (info.droppedMips == 0 && info.bytes > 0) {
+				entry.fullBytes = info.bytes;
+				entry.restoring = false;
+			}
+			residentBytes += info.bytes;
+			if (entry.lastUsedFrame != frame && info.bytes > 0)
+				idle.push_back(&entry);
+		}
+		frame++;
+		if (residentBytes <= budgetBytes)
+			return;
+
+		std::sort(idle.begin(), idle.end(), [](const Entry* a, const Entry* b) { return a->lastUsedFrame < b->lastUsedFrame; });
+
+		// Nobody holds these, they go first
+		for (Entry*& entry : idle) {
+			if (residentBytes <= budgetBytes)
+				return;
+			if (entry->refCount > 0)
+				continue;
+			residentBytes -= loader.info(entry->handle).bytes;
+			loader.release(entry->handle);
+			forget(entry->key);
+			entry = nullptr;
+			stats.evictions++;
+		}
+
+		// Then the ones in use but not drawn lately get smaller
+		for (Entry* entry : idle) {
+			while (entry != nullptr && residentBytes > budgetBytes) {
+				const TextureInfo& info = loader.info(entry->handle);
+				size_t before = info.bytes;
+				if (std::max(info.width, info.height) / 2 < minimumSize || !loader.dropTopMip(entry->handle))
+					break;
+				residentBytes -= before - loader.info(entry->handle).bytes;
+				stats.mipsDropped++;
+			}
+		}
+	}
+
+private:
+	TextureLoader& loader;
+	std::unordered_map<uint64_t, Entry> entries;
+	// Path -> content key, so a path is only hashed the first time
+	std::unordered_map<std::string, uint64_t> pathKeys;
+	uint64_t frame = 0;
+
+	Entry* get(const TextureRef& ref) {
+		return ref.manager == this ? ref.entry : nullptr;
+	}
+
+	void retain(const TextureRef& ref) {
+		if (Entry* entry = get(ref))
+			entry->refCount++;
+	}
+
+	void release(const TextureRef& ref) {
+		if (Entry* entry = get(ref))
+			entry->refCount--;
+	}
+
+	// FNV-1a of the file contents (and the options, they give a different texture)
+	uint64_t keyOf(const std::string& path, bool flipVertically, bool srgb) {
+		std::string pathKey = path + (flipVertically ? "|flip" : "") + (srgb ? "|srgb" : "");
+		auto found = pathKeys.find(pathKey);
+		if (found != pathKeys.end())
+			return found->second;
+
+		// The pack already stores the hash of its files (same FNV-1a), no need to read them
+		FileSpan packed = loader.files != nullptr ? loader.files->find(path) : FileSpan();
+		uint64_t key;
+		if (!packed.empty())
+			key = packed.contentHash;
+		else {
+			MappedFile file(path);
+			key = file.isOpen()
+				? ProgramCache::contentHash((const char*)file.data(), file.size())
+				: ProgramCache::contentHash(path.data(), path.size());
+		}
+		key = ProgramCache::hashBytes(key, flipVertically ? "1" : "0", 1);
+		key = ProgramCache::hashBytes(key, srgb ? "1" : "0", 1);
+		pathKeys[pathKey] = key;
+		return key;
+	}
+
+	void forget(uint64_t key) {
+		for (auto it = pathKeys.begin(); it != pathKeys.end();) {
+			if (it->second == key)
+				it = pathKeys.erase(it);
+			else
+				++it;
+		}
+		entries.erase(key);
+	}
+};
+
+inline TextureRef::TextureRef(const TextureRef& other) : entry(other.entry), manager(other.manager) {
+	if (manager)
+		manager->retain(*this);
+}
+
+inline TextureRef& TextureRef::operator=(const TextureRef& other) {
+	if (this != &other) {
+		if (manager)
+			manager->release(*this);
+		entry = other.entry;
+		manager = other.manager;
+		if (manager)
+			manager->retain(*this);
+	}
+	return *this;
+}
+
+inline TextureRef::~TextureRef() {
+	if (manager)
+		manager->release(*this);
+}
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef TEXTURE_PACKER_H
+#define TEXTURE_PACKER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+
+#include "texture_loader.h"
+#include "skyline_packer.h"
+#include "gl_state.h"
+
+// Where a packed texture ended up
+struct TextureSlot {
+	// GL_TEXTURE_2D_ARRAY to bind
+	unsigned int array = 0;
+	int layer = 0;
+	// Offset (xy) and scale (zw) that take the texture's UVs to the layer's
+	glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+/*
+	Puts many 2D textures into a few GL_TEXTURE_2D_ARRAYs, so drawing with
+	a different texture is choosing another layer (a uniform) instead of
+	binding another texture, and draws with different materials can be
+	batched together.
+
+	Every layer of an array has the same size and format, so:
+		- textures with the same size and format become the layers of
+		  one array, and are sampled exactly as before
+		- the ones left over (one of a kind sizes) are packed side by side
+		  into atlas layers with a SkylinePacker, and their UVs are
+		  remapped with the slot's uvRect
+
+	The textures are copied on the GPU with glCopyImageSubData, mips
+	included, so anything the TextureLoader made works, block compressed
+	.ktx2 textures too. After pack() the originals can be deleted.
+
+	Atlas textures can't use GL_REPEAT (their neighbours would show) and
+	keep fewer mip levels: each rectangle is aligned and padded so that it
+	still has its own texels at the smallest level kept.
+*/
+class TexturePacker {
+
+public:
+	// Largest atlas layer, bigger textures get an array of their own
+	int maxAtlasSize;
+	// Mip levels kept by atlases, each one more doubles the alignment and padding
+	int maxAtlasLevels = 5;
+
+	struct Stats {
+		unsigned int arrays = 0;
+		unsigned int layers = 0;
+		unsigned int atlasLayers = 0;
+		// Fraction of the atlas layers covered by textures
+		float atlasOccupancy = 0.0f;
+	} stats;
+
+	explicit TexturePacker(int maxAtlasSize = 2048) : maxAtlasSize(maxAtlasSize) {}
+
+	TexturePacker(const TexturePacker&) = delete;
+	TexturePacker& operator=(const TexturePacker&) = delete;
+
+	// Queues an uploaded texture, returns the index of its slot after pack()
+	// (a texture that never loaded, with no levels, keeps an empty slot)
+	int add(unsigned int texture, const TextureInfo& info) {
+		sources.push_back({ texture, info });
+		slots.push_back(TextureSlot());
+		return (int)sources.size() - 1;
+	}
+
+	// Creates the arrays and copies every queued texture into them, on the GL thread
+	void pack() {
+		std::map<std::tuple<GLenum, int, int>, std::vector<int>> groups;
+		for (size_t i = 0; i < sources.size(); i++) {
+			if (slots[i].array == 0 && sources[i].info.levels > 0)
+				groups[std::make_tuple(sources[i].info.internalFormat, sources[i].info.width, sources[i].info.height)].push_back((int)i);
+		}
+
+		std::map<GLenum, std::vector<int>> leftovers;
+		for (auto& group : groups) {
+			if (group.second.size() > 1)
+				packLayers(group.second);
+			else
+				leftovers[std::get<0>(group.first)].push_back(group.second[0]);
+		}
+		for (auto& formatGroup : leftovers)
+			packAtlas(formatGroup.second);
+	}
+
+	const TextureSlot& slot(int index) const {
+		return slots[index];
+	}
+
+	void deleteTextures() {
+		GLState::deleteTextures((int)arrays.size(), arrays.data());
+		arrays.clear();
+	}
+
+private:
+	struct Source {
+		unsigned int texture;
+		TextureInfo info;
+	};
+	std::vector<Source> sources;
+	std::vector<TextureSlot> slots;
+	std::vector<unsigned int> arrays;
+	// Sums of the atlas occupancies, for the stats
+	float occupancySum = 0.0f;
+
+	// Texels per side of a block, copies of compressed textures must cover whole blocks
+	static int blockSize(GLenum internalFormat) {
+		switch (internalFormat) {
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM: case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+			return 4;
+		default:
+			return 1;
+		}
+	}
+
+	// Pixel format glClearTexImage takes for the sized format, 0 for compressed ones
+	static GLenum clearFormat(GLenum internalFormat) {
+		switch (internalFormat) {
+		case GL_RGBA8: case GL_SRGB8_ALPHA8: return GL_RGBA;
+		case GL_RG8: return GL_RG;
+		case GL_R8: return GL_RED;
+		default: return 0;
+		}
+	}
+
+	unsigned int createArray(GLenum internalFormat, int width, int height, int levels, int layers, bool atlas) {
+		unsigned int array;
+		glGenTextures(1, &array);
+		GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, array);
+		GLenum wrap = atlas ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internalFormat, width, height, layers);
+
+		// The padding between atlas rectangles is sampled by filtering, make it transparent black
+		if (atlas && clearFormat(internalFormat) != 0) {
+			for (int level = 0; level < levels; level++)
+				glClearTexImage(array, level, clearFormat(internalFormat), GL_UNSIGNED_BYTE, NULL);
+		}
+
+		arrays.push_back(array);
+		stats.arrays++;
+		stats.layers += layers;
+		return array;
+	}
+
+	void copy(const Source& source, unsigned int array, int layer, int x, int y, int levels) {
+		for (int level = 0; level < levels; level++) {
+			glCopyImageSubData(source.texture, GL_TEXTURE_2D, level, 0, 0, 0,
+				array, GL_TEXTURE_2D_ARRAY, level, x >> level, y >> level, layer,
+				std::max(1, source.info.width >> level), std::max(1, source.info.height >> level), 1);
+		}
+	}
+
+	// Same size and format, one layer each
+	void packLayers(const std::vector<int>& indices) {
+		const TextureInfo& first = sources[indices[0]].info;
+		int levels = first.levels;
+		for (int index : indices)
+			levels = std::min(levels, sources[index].info.levels);
+
+		unsigned int array = createArray(first.internalFormat, first.width, first.height, levels, (int)indices.size(), false);
+		for (size_t layer = 0; layer < indices.size(); layer++) {
+			copy(sources[indices[layer]], array, (int)layer, 0, 0, levels);
+			slots[indices[layer]].array = array;
+			slots[indices[layer]].layer = (int)layer;
+		}
+	}
+
+	// Mixed sizes with one format, side by side in as few layers as they fit
+	void packAtlas(std::vector<int> indices) {
+		GLenum internalFormat = sources[indices[0]].info.internalFormat;
+		int block = blockSize(internalFormat);
+
+		// Textures an atlas can't take get an array of their own
+		int levels = maxAtlasLevels;
+		std::vector<int> atlased;
+		for (int index : indices) {
+			const TextureInfo& info = sources[index].info;
+			bool fits = info.width < maxAtlasSize && info.height < maxAtlasSize && info.width % block == 0 && info.height % block == 0;
+			if (fits) {
+				atlased.push_back(index);
+				levels = std::min(levels, info.levels);
+			}
+			else
+				packLayers({ index });
+		}
+		if (atlased.size() < 2) {
+			for (int index : atlased)
+				packLayers({ index });
+			return;
+		}
+
+		// Compressed levels must stay whole blocks at every level kept
+		while (block > 1 && levels > 1) {
+			bool whole = true;
+			for (int index : atlased) {
+				const TextureInfo& info = sources[index].info;
+				whole = whole && info.width % (block << (levels - 1)) == 0 && info.height % (block << (levels - 1)) == 0;
+			}
+			if (whole)
+				break;
+			levels--;
+		}
+
+		// Rectangles start on multiples of alignment and are followed by that much padding,
+		// so at the smallest level kept they're still a block apart
+		int alignment = block << (levels - 1);
+		auto padded = [alignment](int size) {
+			return (size + alignment - 1) / alignment * alignment + alignment;
+		};
+		for (size_t i = 0; i < atlased.size();) {
+			const TextureInfo& info = sources[atlased[i]].info;
+			if (padded(info.width) > maxAtlasSize || padded(info.height) > maxAtlasSize) {
+				packLayers({ atlased[i] });
+				atlased.erase(atlased.begin() + i);
+			}
+			else
+				i++;
+		}
+		if (atlased.empty())
+			return;
+
+		// Tallest first packs best, then the layer size is the smallest power of two holding them all
+		std::sort(atlased.begin(), atlased.end(), [this](int a, int b) {
+			return sources[a].info.height > sources[b].info.height;
+		});
+		size_t area = 0;
+		int size = 1;
+		for (int index : atlased) {
+			const TextureInfo& info = sources[index].info;
+			area += (size_t)padded(info.width) * padded(info.height);
+			size = std::max(size, std::max(padded(info.width), padded(info.height)));
+		}
+		int layerSize = 1;
+		while (layerSize < size || ((size_t)layerSize * layerSize < area && layerSize < maxAtlasSize))
+			layerSize *= 2;
+		layerSize = std::min(layerSize, maxAtlasSize);
+
+		std::vector<SkylinePacker> layers;
+		std::vector<int> placedLayer(atlased.size()), placedX(atlased.size()), placedY(atlased.size());
+		for (size_t i = 0; i < atlased.size(); i++) {
+			const TextureInfo& info = sources[atlased[i]].info;
+			int w = padded(info.width), h = padded(info.height);
+			size_t layer = 0;
+			while (layer < layers.size() && !layers[layer].insert(w, h, placedX[i], placedY[i]))
+				layer++;
+			if (layer == layers.size()) {
+				layers.emplace_back(layerSize, layerSize);
+				layers.back().insert(w, h, placedX[i], placedY[i]);
+			}
+			placedLayer[i] = (int)layer;
+		}
+
+		unsigned int array = createArray(internalFormat, layerSize, layerSize, levels, (int)layers.size(), true);
+		for (size_t i = 0; i < atlased.size(); i++) {
+			const TextureInfo& info = sources[atlased[i]].info;
+			copy(sources[atlased[i]], array, placedLayer[i], placedX[i], placedY[i], levels);
+
+			// Inset by half a texel, so linear filtering at the edges doesn't reach the padding
+			TextureSlot& slot = slots[atlased[i]];
+			slot.array = array;
+			slot.layer = placedLayer[i];
+			slot.uvRect = glm::vec4(placedX[i] + 0.5f, placedY[i] + 0.5f, info.width - 1.0f, info.height - 1.0f) / (float)layerSize;
+		}
+
+		for (const SkylinePacker& layer : layers) {
+			occupancySum += layer.occupancy();
+			stats.atlasLayers++;
+		}
+		stats.atlasOccupancy = occupancySum / stats.atlasLayers;
+	}
+};
+
+#endif
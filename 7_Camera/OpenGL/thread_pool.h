@@ -0,0 +1,137 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+/*
+	Fixed set of worker threads running jobs from a queue.
+	Used for the work that doesn't need the GL context (decoding images,
+	compressing blocks, building mips...), so it spreads over every core.
+*/
+class ThreadPool {
+
+public:
+	// 0 threads means one per core
+	explicit ThreadPool(unsigned int threadCount = 0) {
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back(&ThreadPool::run, this);
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t size() const {
+		return workers.size();
+	}
+
+	void submit(std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(std::move(job));
+			busy++;
+		}
+		wake.notify_one();
+	}
+
+	// Blocks until the queue is empty and no job is running
+	void wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [this] { return busy == 0; });
+	}
+
+	/*
+		Calls body(begin, end) over [0, count) split in chunks of about
+		chunkSize items, spread over the pool, and waits for all of them.
+		The calling thread works on chunks too instead of just waiting.
+	*/
+	void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& body) {
+		if (count == 0)
+			return;
+
+		// Shared with the helpers, one of them may still be returning after the last chunk is done
+		struct Loop {
+			std::function<void(size_t, size_t)> body;
+			size_t count, chunkSize, chunks;
+			std::atomic<size_t> next{ 0 };
+			std::atomic<size_t> done{ 0 };
+			std::mutex mutex;
+			std::condition_variable allDone;
+		};
+		std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+		loop->body = body;
+		loop->count = count;
+		loop->chunkSize = std::max<size_t>(1, chunkSize);
+		loop->chunks = (count + loop->chunkSize - 1) / loop->chunkSize;
+
+		auto work = [loop] {
+			size_t chunk;
+			while ((chunk = loop->next++) < loop->chunks) {
+				size_t begin = chunk * loop->chunkSize;
+				loop->body(begin, std::min(loop->count, begin + loop->chunkSize));
+				if (++loop->done == loop->chunks) {
+					std::lock_guard<std::mutex> lock(loop->mutex);
+					loop->allDone.notify_all();
+				}
+			}
+		};
+
+		size_t helpers = std::min(workers.size(), loop->chunks - 1);
+		for (size_t i = 0; i < helpers; i++)
+			submit(work);
+		work();
+
+		std::unique_lock<std::mutex> lock(loop->mutex);
+		loop->allDone.wait(lock, [&] { return loop->done == loop->chunks; });
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	size_t busy = 0;
+	bool stopping = false;
+
+	void run() {
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (stopping && jobs.empty())
+					return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--busy == 0)
+					idle.notify_all();
+			}
+		}
+	}
+};
+
+#endif
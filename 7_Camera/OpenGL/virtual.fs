@@ -0,0 +1,30 @@
+#version 460 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
+layout (location = 0) out vec4 FragColor;
+
+layout (location = 0) in vec2 TexCoord;
+
+// shader.fs with texture1 streamed from a virtual texture
+#include "virtual_texture.glsl"
+#include "material_table.glsl"
+
+layout (location = 2) uniform int materialId;
+
+// Same as shader.fs: fixed at compile time or set from the program
+#ifdef USE_MIX_UNIFORM
+layout (location = 1) uniform float mixAmount;
+#else
+#ifndef MIX_AMOUNT
+#define MIX_AMOUNT 0.2
+#endif
+const float mixAmount = MIX_AMOUNT;
+#endif
+
+void main()
+{
+	Material material = materials[materialId];
+	FragColor = mix(sampleVirtual(TexCoord),
+					sampleMaterial(material.textures[1], TexCoord), mixAmount);
+}
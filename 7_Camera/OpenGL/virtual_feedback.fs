@@ -0,0 +1,12 @@
+#version 460 core
+// Feedback pass of the virtual texture, drawn into VirtualTexture's small framebuffer
+layout (location = 0) out uint Feedback;
+
+layout (location = 0) in vec2 TexCoord;
+
+#include "virtual_texture.glsl"
+
+void main()
+{
+	Feedback = virtualFeedback(TexCoord);
+}
@@ -0,0 +1,138 @@
+#ifndef VIRTUAL_FILE_SYSTEM_H
+#define VIRTUAL_FILE_SYSTEM_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+
+#include "asset_pack.h"
+#include "mapped_file.h"
+
+// Bytes of a file inside a mounted pack, valid as long as the pack stays mounted
+struct FileSpan {
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+	// Hash of the contents stored in the pack (AssetPack::Entry::contentHash)
+	uint64_t contentHash = 0;
+
+	bool empty() const {
+		return data == nullptr;
+	}
+};
+
+/*
+	Read-only file system over an asset pack (see asset_pack.h).
+
+	mount() maps the whole pack once, find() is a binary search in its
+	index and returns a span pointing into the mapping: no open/read/close
+	per asset and no copy, the bytes go straight to stbi_load_from_memory
+	(or to OpenGL). Pages are loaded by the OS when they are first read.
+
+	Lookups don't change anything, so find() can be called from any thread
+	once mount() is done. Paths are normalized the same way as when packing,
+	"./container.jpg" finds "container.jpg".
+*/
+class VirtualFileSystem {
+
+public:
+	VirtualFileSystem() {}
+
+	VirtualFileSystem(const VirtualFileSystem&) = delete;
+	VirtualFileSystem& operator=(const VirtualFileSystem&) = delete;
+
+	bool mount(const std::string& packPath) {
+		unmount();
+		if (!pack.open(packPath)) {
+			std::cout << "ERROR::VFS::PACK_NOT_SUCCESFULLY_READ\n" << packPath << std::endl;
+			return false;
+		}
+
+		if (pack.size() < sizeof(header))
+			return fail(packPath, "TRUNCATED");
+		std::memcpy(&header, pack.data(), sizeof(header));
+		if (std::memcmp(header.magic, AssetPack::magic, sizeof(AssetPack::magic)) != 0)
+			return fail(packPath, "NOT_A_PACK");
+		if (header.version != AssetPack::version)
+			return fail(packPath, "UNSUPPORTED_VERSION");
+		if (header.indexOffset + (uint64_t)header.entryCount * sizeof(AssetPack::Entry) > header.namesOffset
+			|| header.namesOffset > pack.size())
+			return fail(packPath, "BAD_INDEX");
+
+		entries = (const AssetPack::Entry*)(pack.data() + header.indexOffset);
+		names = (const char*)pack.data() + header.namesOffset;
+		for (uint32_t i = 0; i < header.entryCount; i++) {
+			const AssetPack::Entry& entry = entries[i];
+			if (entry.offset + entry.size > pack.size() || header.namesOffset + entry.nameOffset + entry.nameLength > pack.size())
+				return fail(packPath, "BAD_ENTRY");
+		}
+		return true;
+	}
+
+	void unmount() {
+		pack.close();
+		entries = nullptr;
+		names = nullptr;
+		header = {};
+	}
+
+	bool mounted() const {
+		return pack.isOpen();
+	}
+
+	// Empty span if the pack doesn't have the file (or nothing is mounted)
+	FileSpan find(const std::string& path) const {
+		FileSpan span;
+		if (entries == nullptr)
+			return span;
+
+		std::string name = AssetPack::normalize(path);
+		uint64_t pathHash = AssetPack::hash(name.data(), name.size());
+		uint32_t first = 0, last = header.entryCount;
+		while (first < last) {
+			uint32_t middle = first + (last - first) / 2;
+			if (entries[middle].pathHash < pathHash)
+				first = middle + 1;
+			else
+				last = middle;
+		}
+		if (first == header.entryCount || entries[first].pathHash != pathHash)
+			return span;
+
+		// Two paths could share a hash, the stored name decides
+		const AssetPack::Entry& entry = entries[first];
+		if (entry.nameLength != name.size() || std::memcmp(names + entry.nameOffset, name.data(), name.size()) != 0)
+			return span;
+		span.data = pack.data() + entry.offset;
+		span.size = (size_t)entry.size;
+		span.contentHash = entry.contentHash;
+		return span;
+	}
+
+	bool exists(const std::string& path) const {
+		return !find(path).empty();
+	}
+
+	// Files in the pack, and the different contents they share
+	uint32_t fileCount() const {
+		return header.entryCount;
+	}
+
+	uint32_t blobCount() const {
+		return header.blobCount;
+	}
+
+private:
+	MappedFile pack;
+	AssetPack::Header header = {};
+	const AssetPack::Entry* entries = nullptr;
+	const char* names = nullptr;
+
+	bool fail(const std::string& path, const char* reason) {
+		std::cout << "ERROR::VFS::" << reason << "\n" << path << std::endl;
+		unmount();
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,48 @@
+// Virtual texture sampling, the textures and uniforms are set by VirtualTexture (virtual_texture.h)
+// Per tile of every level: cache slot (xy) and the level of the tile actually there (z)
+layout (binding = 8) uniform usampler2D virtualPageTable;
+// Tiles in the cache, each with a border so it can be filtered on its own
+layout (binding = 9) uniform sampler2D virtualCache;
+// Width and height of level 0, tile size and border, in texels
+layout (location = 10) uniform vec4 virtualInfo;
+// Added to the level, the feedback pass is drawn smaller so its derivatives are bigger
+layout (location = 11) uniform float virtualLodBias;
+
+// Mip level a pixel needs, from how many texels it covers
+int virtualLevel(vec2 uv)
+{
+	vec2 texels = uv * virtualInfo.xy;
+	vec2 dx = dFdx(texels), dy = dFdy(texels);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + virtualLodBias;
+	return clamp(int(floor(lod)), 0, textureQueryLevels(virtualPageTable) - 1);
+}
+
+ivec2 virtualTile(vec2 uv, int level)
+{
+	ivec2 tiles = textureSize(virtualPageTable, level);
+	return clamp(ivec2(uv * virtualInfo.xy / (virtualInfo.z * exp2(float(level)))), ivec2(0), tiles - 1);
+}
+
+vec4 sampleVirtual(vec2 uv)
+{
+	uv = clamp(uv, 0.0, 1.0);
+	int level = virtualLevel(uv);
+	uvec4 entry = texelFetch(virtualPageTable, virtualTile(uv, level), level);
+
+	// It may be a coarser tile, standing in until the wanted one is streamed in
+	int mapped = int(entry.z);
+	vec2 texels = uv * virtualInfo.xy / exp2(float(mapped));
+	vec2 inTile = texels - virtualInfo.z * vec2(virtualTile(uv, mapped));
+	float padded = virtualInfo.z + 2.0 * virtualInfo.w;
+	vec2 physical = vec2(entry.xy) * padded + virtualInfo.w + inTile;
+	return textureLod(virtualCache, physical / vec2(textureSize(virtualCache, 0)), 0.0);
+}
+
+// What the feedback pass writes: the level, y and x of the tile wanted, in 4, 14 and 14 bits
+uint virtualFeedback(vec2 uv)
+{
+	uv = clamp(uv, 0.0, 1.0);
+	int level = virtualLevel(uv);
+	ivec2 tile = virtualTile(uv, level);
+	return (uint(level) << 28) | (uint(tile.y) << 14) | uint(tile.x);
+}
@@ -0,0 +1,425 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+
+#include "virtual_texture_file.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "gl_state.h"
+#include "shader.h"
+
+// Texture units of the page table and the tile cache (virtual_texture.glsl)
+#define VIRTUAL_PAGE_TABLE_UNIT 8
+#define VIRTUAL_CACHE_UNIT 9
+
+/*
+	Texture bigger than the GPU memory it's given, streamed in tiles.
+
+	Instead of uploading the whole image and its mips, only the tiles the
+	camera actually sees are kept, in a tile cache texture of a fixed size
+	(cacheTiles x cacheTiles tiles). The shaders find them through the
+	page table: a small integer texture with one texel per tile of every
+	level, holding where in the cache the tile is. Tiles that aren't in the
+	cache point to the closest coarser tile that is, so something blurrier
+	is drawn until the right one arrives. The last level (a single tile)
+	is loaded up front and never evicted, so there's always one.
+
+	Which tiles are needed is found by the feedback pass: the scene is
+	drawn small (feedbackWidth x feedbackHeight) with virtual_feedback.fs,
+	which writes the id of the tile each pixel samples. The result is read
+	back through a pixel pack buffer a frame later, so the GPU is never
+	waited on.
+
+	The tiles come from a .vtex file (Tools/TextureCooker --virtual)
+	mapped in memory. A streaming thread copies requested tiles out of the
+	mapping, which is where the file is actually read, and update() uploads
+	a few of them per frame into cache slots, evicting the least recently
+	seen tiles when the cache is full.
+*/
+class VirtualTexture {
+
+public:
+	VirtualTextureFile::Header header = {};
+	// GL_RGBA8UI, per tile: cache slot x, y and the level of the tile it points to
+	unsigned int pageTable = 0;
+	unsigned int cache = 0;
+	int cacheTiles;
+	int feedbackWidth, feedbackHeight;
+	// Tiles uploaded to the cache per update(), at most
+	int tilesPerFrame = 8;
+
+	struct Stats {
+		unsigned int requests = 0;
+		unsigned int uploads = 0;
+		unsigned int evictions = 0;
+		// Requests dropped because every cache slot was in use
+		unsigned int cacheFull = 0;
+	} stats;
+
+	explicit VirtualTexture(int cacheTiles = 8, int feedbackWidth = 160, int feedbackHeight = 120)
+		: cacheTiles(cacheTiles), feedbackWidth(feedbackWidth), feedbackHeight(feedbackHeight), streamer(1) {}
+
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	~VirtualTexture() {
+		// Streaming jobs write into this object
+		streamer.wait();
+	}
+
+	// Maps the tile file and creates the textures, on the GL thread
+	bool open(const std::string& path) {
+		if (!file.open(path)) {
+			std::cout << "ERROR::VIRTUAL_TEXTURE::FILE_NOT_SUCCESFULLY_READ\n" << path << std::endl;
+			return false;
+		}
+		if (file.size() < sizeof(header))
+			return fail(path, "TRUNCATED");
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (std::memcmp(header.magic, VirtualTextureFile::magic, sizeof(header.magic)) != 0 || header.version != VirtualTextureFile::version)
+			return fail(path, "NOT_A_VTEX_FILE");
+		if (header.levelCount == 0 || header.levelCount != VirtualTextureFile::levelCount(header.width, header.height, header.tileSize)
+			|| header.levelCount > 16 || header.width / header.tileSize > (1u << 14) || header.height / header.tileSize > (1u << 14))
+			return fail(path, "BAD_SIZE");
+		if (header.tileCount != VirtualTextureFile::firstTile(header, header.levelCount)
+			|| header.dataOffset + header.tileCount * VirtualTextureFile::tileBytes(header) > file.size())
+			return fail(path, "TRUNCATED");
+
+		for (uint32_t level = 0; level < header.levelCount; level++)
+			firstTiles.push_back(VirtualTextureFile::firstTile(header, level));
+		slotOfTile.assign(header.tileCount, -1);
+		inFlight.assign(header.tileCount, false);
+		tileOfSlot.assign((size_t)cacheTiles * cacheTiles, -1);
+		slotLastUsed.assign(tileOfSlot.size(), 0);
+
+		createTextures();
+		createFeedback();
+
+		// The single tile of the last level is always there to fall back on
+		uint32_t last = header.tileCount - 1;
+		upload(last, file.data() + header.dataOffset + last * VirtualTextureFile::tileBytes(header));
+		rebuildPageTable();
+		return true;
+	}
+
+	bool valid() const {
+		return pageTable != 0;
+	}
+
+	size_t residentCount() const {
+		return (size_t)std::count_if(slotOfTile.begin(), slotOfTile.end(), [](int slot) { return slot >= 0; });
+	}
+
+	// Binds the textures and sets the uniforms of virtual_texture.glsl, the program must be in use
+	void bind(Shader& shader, float lodBias = 0.0f) {
+		GLState::bindTexture(VIRTUAL_PAGE_TABLE_UNIT, GL_TEXTURE_2D, pageTable);
+		GLState::bindTexture(VIRTUAL_CACHE_UNIT, GL_TEXTURE_2D, cache);
+		constexpr UniformHandle infoUniform("virtualInfo");
+		constexpr UniformHandle lodBiasUniform("virtualLodBias");
+		shader.setVec4(infoUniform, glm::vec4(header.width, header.height, header.tileSize, header.border));
+		shader.setFloat(lodBiasUniform, lodBias);
+	}
+
+	/*
+		Starts the feedback pass: what's drawn until endFeedback() goes to
+		the small feedback framebuffer, with a program that writes
+		virtualFeedback() (virtual_feedback.fs).
+	*/
+	void beginFeedback(Shader& feedbackShader) {
+		if (!GLState::cache.valid)
+			GLState::sync();
+		std::memcpy(savedViewport, GLState::cache.viewport, sizeof(savedViewport));
+
+		glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+		GLState::viewport(0, 0, feedbackWidth, feedbackHeight);
+		const GLuint nothing[4] = { 0xFFFFFFFFu, 0, 0, 0 };
+		glClearBufferuiv(GL_COLOR, 0, nothing);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		// Drawn smaller, the derivatives are bigger: the bias brings the levels back to the window's
+		float bias = savedViewport[2] > 0 ? std::log2((float)feedbackWidth / savedViewport[2]) : 0.0f;
+		feedbackShader.use();
+		bind(feedbackShader, bias);
+	}
+
+	// Queues the read back of the feedback and goes back to the window's framebuffer
+	void endFeedback() {
+		// The previous read back in this buffer wasn't processed yet, skip this one
+		if (fences[writeIndex] == 0) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[writeIndex]);
+			glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, (void*)0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			fences[writeIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			writeIndex ^= 1;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::viewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+	}
+
+	/*
+		Once per frame on the GL thread: reads the finished feedback,
+		requests the missing tiles, uploads streamed ones and updates the
+		page table if anything moved.
+	*/
+	void update() {
+		readFeedback();
+
+		std::deque<Streamed> arrived;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			int count = std::min((int)streamed.size(), tilesPerFrame);
+			for (int i = 0; i < count; i++) {
+				arrived.push_back(std::move(streamed.front()));
+				streamed.pop_front();
+			}
+		}
+		bool changed = false;
+		for (Streamed& tile : arrived) {
+			inFlight[tile.index] = false;
+			changed = upload(tile.index, tile.pixels.data()) || changed;
+		}
+		if (changed)
+			rebuildPageTable();
+		frame++;
+	}
+
+	// Call before glfwTerminate()
+	void destroy() {
+		streamer.wait();
+		for (GLsync& fence : fences) {
+			if (fence != 0)
+				glDeleteSync(fence);
+			fence = 0;
+		}
+		glDeleteBuffers(2, readbackBuffers);
+		glDeleteFramebuffers(1, &feedbackFBO);
+		glDeleteRenderbuffers(1, &feedbackDepth);
+		unsigned int textures[3] = { pageTable, cache, feedbackColor };
+		GLState::deleteTextures(3, textures);
+		pageTable = cache = feedbackColor = 0;
+		file.close();
+	}
+
+private:
+	MappedFile file;
+	// The streaming thread
+	ThreadPool streamer;
+	std::vector<uint32_t> firstTiles;
+
+	// Tiles are named by their index in the file
+	std::vector<int> slotOfTile;
+	std::vector<int> tileOfSlot;
+	std::vector<uint64_t> slotLastUsed;
+	std::vector<bool> inFlight;
+	uint64_t frame = 1;
+
+	struct Streamed {
+		uint32_t index;
+		std::vector<uint8_t> pixels;
+	};
+	std::mutex mutex;
+	std::deque<Streamed> streamed;
+
+	unsigned int feedbackFBO = 0, feedbackColor = 0, feedbackDepth = 0;
+	unsigned int readbackBuffers[2] = {};
+	GLsync fences[2] = {};
+	int writeIndex = 0, readIndex = 0;
+	int savedViewport[4] = {};
+
+	bool fail(const std::string& path, const char* reason) {
+		std::cout << "ERROR::VIRTUAL_TEXTURE::" << reason << "\n" << path << std::endl;
+		file.close();
+		return false;
+	}
+
+	void createTextures() {
+		glGenTextures(1, &pageTable);
+		GLState::bindTexture(0, GL_TEXTURE_2D, pageTable);
+		// Integer textures can't be filtered, the shader reads them with texelFetch anyway
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexStorage2D(GL_TEXTURE_2D, header.levelCount, GL_RGBA8UI, VirtualTextureFile::tilesX(header, 0), VirtualTextureFile::tilesY(header, 0));
+
+		// One level: the tiles are already the mip level they're needed at, the borders cover bilinear filtering
+		int size = cacheTiles * VirtualTextureFile::paddedSize(header);
+		glGenTextures(1, &cache);
+		GLState::bindTexture(0, GL_TEXTURE_2D, cache);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size, size);
+	}
+
+	void createFeedback() {
+		glGenTextures(1, &feedbackColor);
+		GLState::bindTexture(0, GL_TEXTURE_2D, feedbackColor);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, feedbackWidth, feedbackHeight);
+
+		glGenRenderbuffers(1, &feedbackDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedbackWidth, feedbackHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &feedbackFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::VIRTUAL_TEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		glGenBuffers(2, readbackBuffers);
+		for (unsigned int buffer : readbackBuffers) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+			glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)feedbackWidth * feedbackHeight * 4, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	// Tile index from the id virtualFeedback() writes: level, y and x in 4, 14 and 14 bits
+	bool tileOf(uint32_t id, uint32_t& index) const {
+		uint32_t level = id >> 28, y = (id >> 14) & 0x3FFF, x = id & 0x3FFF;
+		if (level >= header.levelCount || x >= VirtualTextureFile::tilesX(header, level) || y >= VirtualTextureFile::tilesY(header, level))
+			return false;
+		index = firstTiles[level] + y * VirtualTextureFile::tilesX(header, level) + x;
+		return true;
+	}
+
+	void readFeedback() {
+		GLsync fence = fences[readIndex];
+		if (fence == 0 || glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+			return;
+		glDeleteSync(fence);
+		fences[readIndex] = 0;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[readIndex]);
+		const uint32_t* ids = (const uint32_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)feedbackWidth * feedbackHeight * 4, GL_MAP_READ_BIT);
+		std::vector<uint32_t> needed;
+		if (ids != NULL) {
+			needed.assign(ids, ids + (size_t)feedbackWidth * feedbackHeight);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		readIndex ^= 1;
+
+		std::sort(needed.begin(), needed.end());
+		needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+		std::vector<uint32_t> requests;
+		for (uint32_t id : needed) {
+			uint32_t index;
+			if (!tileOf(id, index))
+				continue;
+			if (slotOfTile[index] >= 0)
+				slotLastUsed[slotOfTile[index]] = frame;
+			else if (!inFlight[index])
+				requests.push_back(index);
+		}
+		// Coarse tiles first (they're at the end of the file), they improve the most pixels
+		std::sort(requests.begin(), requests.end(), std::greater<uint32_t>());
+		for (uint32_t index : requests)
+			request(index);
+	}
+
+	void request(uint32_t index) {
+		inFlight[index] = true;
+		stats.requests++;
+		const unsigned char* source = file.data() + header.dataOffset + index * VirtualTextureFile::tileBytes(header);
+		size_t bytes = VirtualTextureFile::tileBytes(header);
+		streamer.submit([this, index, source, bytes] {
+			// Touching the mapped pages here is what reads the file, off the GL thread
+			Streamed tile{ index, std::vector<uint8_t>(source, source + bytes) };
+			std::lock_guard<std::mutex> lock(mutex);
+			streamed.push_back(std::move(tile));
+		});
+	}
+
+	// A free slot, or the one of the tile seen the longest ago, -1 if none
+	// (tiles seen in the last few frames stay: the feedback arrives a frame or two late)
+	int findSlot() {
+		int best = -1;
+		for (int slot = 0; slot < (int)tileOfSlot.size(); slot++) {
+			if (tileOfSlot[slot] < 0)
+				return slot;
+			if (tileOfSlot[slot] == (int)header.tileCount - 1 || slotLastUsed[slot] + 4 >= frame)
+				continue;
+			if (best < 0 || slotLastUsed[slot] < slotLastUsed[best])
+				best = slot;
+		}
+		return best;
+	}
+
+	bool upload(uint32_t index, const uint8_t* pixels) {
+		if (slotOfTile[index] >= 0)
+			return false;
+		int slot = findSlot();
+		if (slot < 0) {
+			stats.cacheFull++;
+			return false;
+		}
+		if (tileOfSlot[slot] >= 0) {
+			slotOfTile[tileOfSlot[slot]] = -1;
+			stats.evictions++;
+		}
+		tileOfSlot[slot] = (int)index;
+		slotOfTile[index] = slot;
+		slotLastUsed[slot] = frame;
+
+		int padded = (int)VirtualTextureFile::paddedSize(header);
+		GLState::bindTexture(0, GL_TEXTURE_2D, cache);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % cacheTiles) * padded, (slot / cacheTiles) * padded, padded, padded,
+			GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		stats.uploads++;
+		return true;
+	}
+
+	/*
+		Every entry points to its own tile when it's in the cache, or else
+		to whatever its parent (the tile covering it one level up) points to.
+		Filled from the last level down, so parents are always done first.
+	*/
+	void rebuildPageTable() {
+		std::vector<uint8_t> coarser, entries;
+		GLState::bindTexture(0, GL_TEXTURE_2D, pageTable);
+		for (int level = (int)header.levelCount - 1; level >= 0; level--) {
+			uint32_t width = VirtualTextureFile::tilesX(header, level), height = VirtualTextureFile::tilesY(header, level);
+			uint32_t coarserWidth = VirtualTextureFile::tilesX(header, level + 1), coarserHeight = VirtualTextureFile::tilesY(header, level + 1);
+			entries.assign((size_t)width * height * 4, 0);
+			for (uint32_t y = 0; y < height; y++) {
+				for (uint32_t x = 0; x < width; x++) {
+					uint8_t* entry = &entries[((size_t)y * width + x) * 4];
+					int slot = slotOfTile[firstTiles[level] + y * width + x];
+					if (slot >= 0) {
+						entry[0] = (uint8_t)(slot % cacheTiles);
+						entry[1] = (uint8_t)(slot / cacheTiles);
+						entry[2] = (uint8_t)level;
+						entry[3] = 1;
+					}
+					else if (!coarser.empty()) {
+						size_t parent = (size_t)std::min(y / 2, coarserHeight - 1) * coarserWidth + std::min(x / 2, coarserWidth - 1);
+						std::memcpy(entry, &coarser[parent * 4], 4);
+					}
+				}
+			}
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entries.data());
+			coarser.swap(entries);
+		}
+	}
+};
+
+#endif
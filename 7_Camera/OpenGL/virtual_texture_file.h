@@ -0,0 +1,142 @@
+#ifndef VIRTUAL_TEXTURE_FILE_H
+#define VIRTUAL_TEXTURE_FILE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+/*
+	Tile file of a virtual texture (.vtex), written by Tools/TextureCooker
+	--virtual and read by VirtualTexture. No OpenGL here so the tools can use it.
+
+	The texture and its mip levels are cut into square tiles of tileSize
+	texels, each one stored with a border of the texels around it (copied
+	from its neighbours, or the clamped edge), so a tile can be filtered
+	on its own once it's in the tile cache. Every tile is RGBA8 and has
+	the same size, so tile i starts at dataOffset + i * tileBytes().
+
+	Layout:
+		header (48 bytes)
+		tiles of level 0, row by row, then level 1 and so on, the last
+		level is a single tile
+
+	The width and height must be the tile size times a power of two, so
+	every level is a whole number of tiles (the small side of a non
+	square texture may end in one partly used tile).
+*/
+namespace VirtualTextureFile {
+
+	const char magic[4] = { 'V', 'T', 'E', 'X' };
+	const uint32_t version = 1;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t tileSize;
+		uint32_t border;
+		uint32_t levelCount;
+		uint32_t tileCount;
+		uint64_t dataOffset;
+		uint64_t reserved;
+	};
+	static_assert(sizeof(Header) == 48, "VTEX header must be 48 bytes");
+
+	inline uint32_t tilesX(const Header& header, uint32_t level) {
+		return std::max(1u, (header.width / header.tileSize) >> level);
+	}
+
+	inline uint32_t tilesY(const Header& header, uint32_t level) {
+		return std::max(1u, (header.height / header.tileSize) >> level);
+	}
+
+	// Index of the first tile of a level
+	inline uint32_t firstTile(const Header& header, uint32_t level) {
+		uint32_t first = 0;
+		for (uint32_t l = 0; l < level; l++)
+			first += tilesX(header, l) * tilesY(header, l);
+		return first;
+	}
+
+	// Side of a stored tile, border included
+	inline uint32_t paddedSize(const Header& header) {
+		return header.tileSize + 2 * header.border;
+	}
+
+	inline uint64_t tileBytes(const Header& header) {
+		return (uint64_t)paddedSize(header) * paddedSize(header) * 4;
+	}
+
+	// Levels down to the one that fits in a single tile, 0 if the size isn't usable
+	inline uint32_t levelCount(uint32_t width, uint32_t height, uint32_t tileSize) {
+		if (tileSize == 0 || width % tileSize != 0 || height % tileSize != 0)
+			return 0;
+		uint32_t x = width / tileSize, y = height / tileSize;
+		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0)
+			return 0;
+		uint32_t levels = 1;
+		while (x > 1 || y > 1) {
+			x = std::max(1u, x / 2);
+			y = std::max(1u, y / 2);
+			levels++;
+		}
+		return levels;
+	}
+
+	/*
+		Writes the tile file. levels[i] is mip level i in RGBA8 (at least
+		levelCount() of them, extra small levels are ignored).
+	*/
+	inline bool write(const std::string& path, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t border,
+		const std::vector<std::vector<uint8_t>>& levels) {
+		uint32_t count = levelCount(width, height, tileSize);
+		if (count == 0 || levels.size() < count)
+			return false;
+
+		Header header = {};
+		std::memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.width = width;
+		header.height = height;
+		header.tileSize = tileSize;
+		header.border = border;
+		header.levelCount = count;
+		header.tileCount = firstTile(header, count);
+		// Tiles start on a page, so the mapping of the first one is aligned
+		header.dataOffset = 4096;
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		file.write((const char*)&header, sizeof(header));
+		std::vector<char> padding(header.dataOffset - sizeof(header), 0);
+		file.write(padding.data(), padding.size());
+
+		uint32_t padded = paddedSize(header);
+		std::vector<uint8_t> tile(tileBytes(header));
+		for (uint32_t level = 0; level < count; level++) {
+			int levelWidth = std::max(1u, width >> level), levelHeight = std::max(1u, height >> level);
+			const uint8_t* pixels = levels[level].data();
+			for (uint32_t ty = 0; ty < tilesY(header, level); ty++) {
+				for (uint32_t tx = 0; tx < tilesX(header, level); tx++) {
+					// Border and the unused part of a partial tile repeat the edge texels
+					for (uint32_t y = 0; y < padded; y++) {
+						int sy = std::clamp((int)(ty * tileSize + y) - (int)border, 0, levelHeight - 1);
+						for (uint32_t x = 0; x < padded; x++) {
+							int sx = std::clamp((int)(tx * tileSize + x) - (int)border, 0, levelWidth - 1);
+							std::memcpy(&tile[((size_t)y * padded + x) * 4], &pixels[((size_t)sy * levelWidth + sx) * 4], 4);
+						}
+					}
+					file.write((const char*)tile.data(), tile.size());
+				}
+			}
+		}
+		return (bool)file;
+	}
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+	AssetPacker: packs the assets of a lesson into one file for
+	VirtualFileSystem (see asset_pack.h).
+
+	Usage: AssetPacker <output.pak> <directories or files...>
+
+	Directories are walked recursively and their files are named by their
+	path inside the directory ("cooked/container.ktx2"), files given on
+	their own by their file name. Only asset files are packed (images,
+	shaders, cooked textures), not the sources next to them.
+
+	Several directories can go in the same pack: a file with the same
+	name in two of them is only packed from the first one, and files
+	with the same contents under different names are stored once.
+*/
+
+#include "../../7_Camera/OpenGL/asset_pack.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+
+namespace fs = std::filesystem;
+
+const char* packedExtensions[] = {
+	".jpg", ".jpeg", ".png", ".tga", ".bmp", ".hdr",
+	".ktx2", ".vtex",
+	".vs", ".fs", ".glsl",
+};
+
+bool isAsset(const fs::path& path) {
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	for (const char* packed : packedExtensions) {
+		if (extension == packed)
+			return true;
+	}
+	return false;
+}
+
+bool readFile(const fs::path& path, std::vector<uint8_t>& contents) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+	contents.resize((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)contents.data(), contents.size());
+	return (bool)file;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cout << "Usage: AssetPacker <output.pak> <directories or files...>" << std::endl;
+		return 1;
+	}
+
+	// Every file to pack and its name in the pack, in a stable order
+	std::vector<std::pair<fs::path, std::string>> sources;
+	for (int i = 2; i < argc; i++) {
+		fs::path input = argv[i];
+		std::error_code error;
+		if (fs::is_directory(input, error)) {
+			std::vector<std::pair<fs::path, std::string>> found;
+			for (const auto& item : fs::recursive_directory_iterator(input, error)) {
+				if (item.is_regular_file() && isAsset(item.path()))
+					found.push_back({ item.path(), fs::relative(item.path(), input).generic_string() });
+			}
+			std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+			sources.insert(sources.end(), found.begin(), found.end());
+		}
+		else if (fs::is_regular_file(input, error))
+			sources.push_back({ input, input.filename().generic_string() });
+		else {
+			std::cout << "ERROR::ASSET_PACKER::INPUT_NOT_FOUND\n" << input.string() << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<AssetPack::File> files;
+	std::set<std::string> names;
+	uint64_t totalBytes = 0;
+	for (const auto& source : sources) {
+		std::string name = AssetPack::normalize(source.second);
+		if (!names.insert(name).second)
+			continue;
+		AssetPack::File file;
+		file.name = name;
+		if (!readFile(source.first, file.contents)) {
+			std::cout << "ERROR::ASSET_PACKER::FILE_NOT_SUCCESFULLY_READ\n" << source.first.string() << std::endl;
+			return 1;
+		}
+		totalBytes += file.contents.size();
+		files.push_back(std::move(file));
+	}
+
+	uint32_t blobCount = 0;
+	if (!AssetPack::write(argv[1], files, &blobCount)) {
+		std::cout << "ERROR::ASSET_PACKER::PACK_NOT_SUCCESFULLY_WRITTEN\n" << argv[1] << std::endl;
+		return 1;
+	}
+
+	std::error_code error;
+	uint64_t packBytes = fs::file_size(argv[1], error);
+	std::cout << "Packed " << files.size() << " files (" << totalBytes / 1024 << " KB) into " << argv[1] << ": "
+		<< blobCount << " stored, " << packBytes / 1024 << " KB" << std::endl;
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+	DecodeBenchmark: times stb_image decoding with malloc and with the
+	per-thread ImageArena the TextureLoader workers use.
+
+	Usage: DecodeBenchmark [--count N] [--threads N] <image files...>
+
+	The files are read into memory first, then decoded --count times in
+	total (1000 by default, going round the files) on a pool of --threads
+	workers (one per core by default), like a bulk texture load. The pixels
+	are copied out of stb_image's buffer each time, as the loader does.
+
+	The same decodes run twice: once with stb_image calling malloc/realloc/free,
+	once inside an ImageArena::Scope per decode. For each it prints the time,
+	images and megabytes (of decoded pixels) per second, and how many times
+	the heap was asked for memory.
+*/
+
+#include "../../7_Camera/OpenGL/image_arena.h"
+#include "../../7_Camera/OpenGL/thread_pool.h"
+
+#include <atomic>
+
+// Same hooks as the lesson's image.cpp, counting the calls that reach the heap
+std::atomic<uint64_t> heapCalls(0);
+
+inline void* countedAllocate(size_t size) {
+	if (ImageArena::active == nullptr)
+		heapCalls++;
+	return ImageArena::allocate(size);
+}
+
+inline void* countedReallocate(void* pointer, size_t size) {
+	if (ImageArena::active == nullptr)
+		heapCalls++;
+	return ImageArena::reallocate(pointer, size);
+}
+
+#define STBI_MALLOC(size) countedAllocate(size)
+#define STBI_REALLOC(pointer, size) countedReallocate(pointer, size)
+#define STBI_FREE(pointer) ImageArena::release(pointer)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+
+struct Result {
+	double seconds = 0.0;
+	uint64_t pixelBytes = 0;
+	uint64_t heapCalls = 0;
+	unsigned int failed = 0;
+};
+
+Result run(const std::vector<std::vector<unsigned char>>& files, unsigned int count, ThreadPool& pool, bool arena) {
+	std::atomic<uint64_t> pixelBytes(0), arenaBlocks(0);
+	std::atomic<unsigned int> failed(0);
+	heapCalls = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++) {
+		const std::vector<unsigned char>& file = files[i % files.size()];
+		pool.submit([&file, arena, &pixelBytes, &arenaBlocks, &failed] {
+			unsigned int blocksBefore = ImageArena::threadArena.blockAllocations;
+			{
+				ImageArena::Scope scope(arena);
+				int width, height, channels;
+				unsigned char* pixels = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &channels, 0);
+				if (pixels == NULL) {
+					failed++;
+					return;
+				}
+				size_t size = (size_t)width * height * channels;
+				std::vector<unsigned char> copy(size);
+				std::memcpy(copy.data(), pixels, size);
+				stbi_image_free(pixels);
+				pixelBytes += size;
+			}
+			arenaBlocks += ImageArena::threadArena.blockAllocations - blocksBefore;
+		});
+	}
+	pool.wait();
+
+	Result result;
+	result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	result.pixelBytes = pixelBytes;
+	result.heapCalls = heapCalls + arenaBlocks;
+	result.failed = failed;
+	return result;
+}
+
+void print(const char* name, const Result& result, unsigned int count) {
+	std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(10) << result.seconds * 1000.0 << " ms"
+		<< std::setw(10) << count / result.seconds << " images/s"
+		<< std::setw(10) << result.pixelBytes / (1024.0 * 1024.0) / result.seconds << " MB/s"
+		<< std::setw(10) << result.heapCalls << " heap allocations";
+	if (result.failed > 0)
+		std::cout << " (" << result.failed << " failed)";
+	std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+	unsigned int count = 1000, threads = 0;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--count" && i + 1 < argc)
+			count = (unsigned int)std::stoul(argv[++i]);
+		else if (argument == "--threads" && i + 1 < argc)
+			threads = (unsigned int)std::stoul(argv[++i]);
+		else
+			paths.push_back(argument);
+	}
+	if (paths.empty() || count == 0) {
+		std::cout << "Usage: DecodeBenchmark [--count N] [--threads N] <image files...>" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::vector<unsigned char>> files;
+	for (const std::string& path : paths) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			std::cout << "ERROR::DECODE_BENCHMARK::FILE_NOT_SUCCESFULLY_READ\n" << path << std::endl;
+			return 1;
+		}
+		files.emplace_back((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	}
+
+	ThreadPool pool(threads);
+	std::cout << "Decoding " << count << " images from " << files.size() << " files on " << pool.size() << " threads" << std::endl;
+
+	// Once untimed, so the file pages and the first arena blocks don't count against either
+	run(files, (unsigned int)pool.size(), pool, true);
+	run(files, (unsigned int)pool.size(), pool, false);
+
+	Result heap = run(files, count, pool, false);
+	Result arena = run(files, count, pool, true);
+	print("malloc", heap, count);
+	print("arena", arena, count);
+	std::cout << "Arena speedup: " << std::setprecision(2) << heap.seconds / arena.seconds << "x" << std::endl;
+	return 0;
+}
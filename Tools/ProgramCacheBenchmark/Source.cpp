@@ -0,0 +1,179 @@
+/*
+	ProgramCacheBenchmark: times creating shader programs with the on-disk
+	binary cache (program_cache.h) empty and then filled.
+
+	Usage: ProgramCacheBenchmark [--programs N] [--osmesa]
+
+	--programs different programs (40 by default) are created with Shader,
+	each one the same pair of files with a different VARIANT define, so
+	every one has its own cache key:
+		cold   shader_cache/ emptied first: every program is compiled and
+		       linked from source, then its binary is stored
+		warm   the same programs again: every one is loaded from the
+		       binary stored by the cold pass
+	and prints the time of both passes and per program.
+
+	The shaders and the cache are written to a temporary directory, which
+	is removed at the end. The window is hidden, so it runs without a GPU
+	on Mesa's llvmpipe (e.g. with Xvfb), or with --osmesa on GLFW's OSMesa
+	backend with no display at all.
+*/
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "../../7_Camera/OpenGL/shader.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <filesystem>
+#include <algorithm>
+
+// Close to the lesson's shaders, with enough math that compiling them costs something
+const char* vertexSource = R"GLSL(#version 450 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 0) out vec2 TexCoord;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+void main() {
+	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	TexCoord = aTexCoord;
+}
+)GLSL";
+
+const char* fragmentSource = R"GLSL(#version 450 core
+layout (location = 0) in vec2 TexCoord;
+layout (location = 0) out vec4 FragColor;
+uniform sampler2D texture1;
+uniform sampler2D texture2;
+uniform float time;
+
+float noise(vec2 p) {
+	vec2 i = floor(p);
+	vec2 f = fract(p);
+	f = f * f * (3.0 - 2.0 * f);
+	float a = fract(sin(dot(i, vec2(12.9898, 78.233))) * 43758.5453);
+	float b = fract(sin(dot(i + vec2(1.0, 0.0), vec2(12.9898, 78.233))) * 43758.5453);
+	float c = fract(sin(dot(i + vec2(0.0, 1.0), vec2(12.9898, 78.233))) * 43758.5453);
+	float d = fract(sin(dot(i + vec2(1.0, 1.0), vec2(12.9898, 78.233))) * 43758.5453);
+	return mix(mix(a, b, f.x), mix(c, d, f.x), f.y);
+}
+
+void main() {
+	vec2 uv = TexCoord * float(VARIANT + 1);
+	float value = 0.0;
+	float amplitude = 0.5;
+	for (int octave = 0; octave < 6; octave++) {
+		value += amplitude * noise(uv + time);
+		uv *= 2.0;
+		amplitude *= 0.5;
+	}
+	vec4 color = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), value);
+	FragColor = vec4(color.rgb * (0.5 + value), color.a);
+}
+)GLSL";
+
+bool writeFile(const std::filesystem::path& path, const char* text) {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file << text;
+	return (bool)file;
+}
+
+// Creates every variant, returns the milliseconds it took and how many linked
+double createPrograms(const std::string& vertexPath, const std::string& fragmentPath, unsigned int count, unsigned int& linked) {
+	std::vector<std::unique_ptr<Shader>> shaders;
+	linked = 0;
+	glFinish();
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < count; i++) {
+		shaders.push_back(std::make_unique<Shader>(vertexPath.c_str(), fragmentPath.c_str(), ShaderDefines{ { "VARIANT", std::to_string(i) } }));
+		if (shaders.back()->ID != 0)
+			linked++;
+	}
+	glFinish();
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	for (auto& shader : shaders)
+		glDeleteProgram(shader->ID);
+	return milliseconds;
+}
+
+int main(int argc, char** argv) {
+	unsigned int programs = 40;
+	bool osmesa = false;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--programs" && i + 1 < argc)
+			programs = std::max(1u, (unsigned int)std::stoul(argv[++i]));
+		else if (argument == "--osmesa")
+			osmesa = true;
+		else {
+			std::cout << "Usage: ProgramCacheBenchmark [--programs N] [--osmesa]" << std::endl;
+			return 1;
+		}
+	}
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	if (osmesa)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "ProgramCacheBenchmark", NULL, NULL);
+	if (window == NULL) {
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	if (!ProgramCache::supported()) {
+		std::cout << "ERROR::PROGRAM_CACHE_BENCHMARK::NO_PROGRAM_BINARY_FORMATS\n" << glGetString(GL_RENDERER) << std::endl;
+		glfwTerminate();
+		return 1;
+	}
+
+	std::error_code error;
+	std::filesystem::path root = std::filesystem::temp_directory_path() / "ProgramCacheBenchmark";
+	std::filesystem::remove_all(root, error);
+	std::filesystem::create_directories(root, error);
+	std::string vertexPath = (root / "benchmark.vs").string();
+	std::string fragmentPath = (root / "benchmark.fs").string();
+	if (!writeFile(vertexPath, vertexSource) || !writeFile(fragmentPath, fragmentSource)) {
+		std::cout << "ERROR::PROGRAM_CACHE_BENCHMARK::FILE_NOT_SUCCESFULLY_WRITTEN\n" << root.string() << std::endl;
+		glfwTerminate();
+		return 1;
+	}
+	ProgramCache::directory = (root / "shader_cache").string();
+
+	unsigned int coldLinked, warmLinked;
+	double cold = createPrograms(vertexPath, fragmentPath, programs, coldLinked);
+	size_t stored = 0;
+	for (const auto& entry : std::filesystem::directory_iterator(ProgramCache::directory, error))
+		stored += entry.path().extension() == ".bin" ? 1 : 0;
+	double warm = createPrograms(vertexPath, fragmentPath, programs, warmLinked);
+
+	std::filesystem::remove_all(root, error);
+
+	std::cout << "Renderer: " << glGetString(GL_RENDERER) << ", " << programs << " programs, "
+		<< stored << " binaries stored" << std::endl;
+	std::cout << std::fixed << std::setprecision(1)
+		<< "cold (compiled) " << std::setw(10) << cold << " ms " << std::setw(8) << cold / programs << " ms/program"
+		<< "  " << coldLinked << " linked" << std::endl
+		<< "warm (cached)   " << std::setw(10) << warm << " ms " << std::setw(8) << warm / programs << " ms/program"
+		<< "  " << warmLinked << " linked" << std::setprecision(2) << "  " << cold / warm << "x" << std::endl;
+
+	glfwTerminate();
+	return coldLinked == programs && warmLinked == programs ? 0 : 1;
+}
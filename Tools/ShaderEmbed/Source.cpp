@@ -0,0 +1,132 @@
+/*
+	ShaderEmbed: build step that turns shader files into a C++ header.
+
+	Usage: ShaderEmbed <output.h> <shader files...>
+
+	Each file becomes an EmbeddedShader (see embedded_shader.h) holding
+	its source as a string literal and the FNV-1a hash of its contents,
+	so the lesson doesn't read the files at runtime. Run it again
+	(e.g. as a pre-build event) whenever a shader changes.
+*/
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <cstdint>
+#include <cstdio>
+#include <cctype>
+
+uint64_t hashContents(const std::string& contents) {
+	// 64 bit FNV-1a, must match ProgramCache::hashBytes
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : contents) {
+		hash ^= (uint8_t)c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// shader.vs -> shader_vs, so it can be used as a C++ name
+std::string identifier(const std::string& name) {
+	std::string result;
+	for (char c : name)
+		result += (std::isalnum((unsigned char)c) ? c : '_');
+	if (result.empty() || std::isdigit((unsigned char)result[0]))
+		result = "_" + result;
+	return result;
+}
+
+bool hasIncludes(const std::string& contents) {
+	std::istringstream lines(contents);
+	std::string line;
+	while (std::getline(lines, line)) {
+		size_t start = line.find_first_not_of(" \t");
+		if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+			return true;
+	}
+	return false;
+}
+
+/*
+	Raw string literal of the contents. It's split in chunks because
+	compilers limit the length of a single literal (MSVC ~16KB),
+	adjacent literals are joined back by the compiler.
+*/
+std::string literal(const std::string& contents) {
+	std::string delimiter = "GLSL";
+	while (contents.find(")" + delimiter + "\"") != std::string::npos)
+		delimiter += "_";
+
+	const size_t chunk = 4000;
+	std::string result;
+	for (size_t i = 0; i < contents.size() || i == 0; i += chunk) {
+		result += "\n\t\tR\"" + delimiter + "(" + contents.substr(i, chunk) + ")" + delimiter + "\"";
+		if (contents.empty())
+			break;
+	}
+	return result;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cout << "Usage: ShaderEmbed <output.h> <shader files...>" << std::endl;
+		return 1;
+	}
+
+	std::string header =
+		"// Generated by Tools/ShaderEmbed, don't edit by hand.\n"
+		"#ifndef EMBEDDED_SHADERS_H\n"
+		"#define EMBEDDED_SHADERS_H\n\n"
+		"#include \"embedded_shader.h\"\n\n"
+		"namespace EmbeddedShaders {\n";
+
+	std::vector<std::string> names;
+	for (int i = 2; i < argc; i++) {
+		std::ifstream file(argv[i], std::ios::binary);
+		if (!file) {
+			std::cout << "ERROR::SHADER_EMBED::FILE_NOT_SUCCESFFULY_READ\n" << argv[i] << std::endl;
+			return 1;
+		}
+		std::stringstream stream;
+		stream << file.rdbuf();
+		std::string contents = stream.str();
+
+		// Stored by file name, that's how the lessons and #include refer to them
+		std::string name = std::filesystem::path(argv[i]).filename().generic_string();
+		names.push_back(identifier(name));
+
+		char hash[32];
+		std::snprintf(hash, sizeof(hash), "0x%016llxull", (unsigned long long)hashContents(contents));
+
+		header += "\n\tinline constexpr EmbeddedShader " + names.back() + " = {\n";
+		header += "\t\t\"" + name + "\",";
+		header += literal(contents) + ",\n";
+		header += "\t\t" + std::string(hash) + ",\n";
+		header += std::string("\t\t") + (hasIncludes(contents) ? "true" : "false") + "\n";
+		header += "\t};\n";
+	}
+
+	header += "\n\t// Every embedded file, for looking them up by name\n";
+	header += "\tinline constexpr EmbeddedShader all[] = {\n";
+	for (size_t i = 0; i < names.size(); i++)
+		header += "\t\t" + names[i] + (i + 1 < names.size() ? ",\n" : "\n");
+	header += "\t};\n}\n\n#endif\n";
+
+	// Only write when something changed, so the lesson isn't rebuilt for nothing
+	std::ifstream previous(argv[1], std::ios::binary);
+	std::stringstream previousStream;
+	previousStream << previous.rdbuf();
+	if (previous && previousStream.str() == header)
+		return 0;
+
+	std::ofstream output(argv[1], std::ios::binary | std::ios::trunc);
+	if (!output) {
+		std::cout << "ERROR::SHADER_EMBED::FILE_NOT_SUCCESFULLY_WRITTEN\n" << argv[1] << std::endl;
+		return 1;
+	}
+	output << header;
+	return 0;
+}
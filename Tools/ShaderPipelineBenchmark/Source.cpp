@@ -0,0 +1,133 @@
+/*
+	ShaderPipelineBenchmark: links the lesson's vertex shader with two
+	fragment shaders, once as normal programs and once as separable stages
+	combined by ShaderPipeline (shader_pipeline.h).
+
+	Usage: ShaderPipelineBenchmark [--osmesa]
+
+	The shaders are the embedded ones of 7_Camera: shader.vs with shader.fs
+	and with virtual.fs. They're GLSL 4.60, so the context is 4.6 like the
+	lesson's.
+		programs    Shader: shader.vs is compiled and linked once per program
+		pipelines   ShaderStageCache: shader.vs is linked once as its own
+		            stage and shared by both pipelines
+	Prints the time of both, how many links each needed and whether the
+	driver validates both pipelines. Asking the cache for the same files
+	again must not link (nor preprocess) anything.
+
+	The binary cache points to a temporary directory that's emptied first,
+	so everything is compiled from source. The window is hidden, so it runs
+	without a GPU on Mesa's llvmpipe (e.g. with Xvfb), or with --osmesa on
+	GLFW's OSMesa backend with no display at all.
+*/
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "../../7_Camera/OpenGL/shader_pipeline.h"
+#include "../../7_Camera/OpenGL/embedded_shaders.h"
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <filesystem>
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+	glFinish();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool validate(const ShaderPipeline& pipeline) {
+	glValidateProgramPipeline(pipeline.ID);
+	int valid = GL_FALSE;
+	glGetProgramPipelineiv(pipeline.ID, GL_VALIDATE_STATUS, &valid);
+	if (valid == GL_FALSE) {
+		char infoLog[1024];
+		glGetProgramPipelineInfoLog(pipeline.ID, 1024, NULL, infoLog);
+		std::cout << "ERROR::SHADER_PIPELINE_BENCHMARK::PIPELINE_NOT_VALID\n" << infoLog << std::endl;
+	}
+	return valid == GL_TRUE;
+}
+
+int main(int argc, char** argv) {
+	bool osmesa = false;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--osmesa")
+			osmesa = true;
+		else {
+			std::cout << "Usage: ShaderPipelineBenchmark [--osmesa]" << std::endl;
+			return 1;
+		}
+	}
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	if (osmesa)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "ShaderPipelineBenchmark", NULL, NULL);
+	if (window == NULL) {
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	// The includes (camera_block.glsl, material_table.glsl...) come from the embedded table too
+	ShaderPreprocessor::useEmbedded(EmbeddedShaders::all);
+	std::error_code error;
+	std::filesystem::path cache = std::filesystem::temp_directory_path() / "ShaderPipelineBenchmark";
+	std::filesystem::remove_all(cache, error);
+	ProgramCache::directory = cache.string();
+
+	// Normal programs, the vertex shader is linked into each one
+	auto start = std::chrono::steady_clock::now();
+	Shader cubeProgram(EmbeddedShaders::shader_vs, EmbeddedShaders::shader_fs);
+	Shader virtualProgram(EmbeddedShaders::shader_vs, EmbeddedShaders::virtual_fs);
+	double programs = millisecondsSince(start);
+
+	// Separable stages, the vertex stage is linked once and shared
+	ShaderStageCache stages;
+	start = std::chrono::steady_clock::now();
+	Shader& vertexStage = stages.stage(GL_VERTEX_SHADER, EmbeddedShaders::shader_vs);
+	ShaderPipeline cubePipeline(vertexStage, stages.stage(GL_FRAGMENT_SHADER, EmbeddedShaders::shader_fs));
+	ShaderPipeline virtualPipeline(vertexStage, stages.stage(GL_FRAGMENT_SHADER, EmbeddedShaders::virtual_fs));
+	double pipelines = millisecondsSince(start);
+	unsigned int pipelineLinks = stages.linkCount;
+
+	// Same files again, answered from the cache without touching the preprocessor
+	start = std::chrono::steady_clock::now();
+	Shader& sharedAgain = stages.stage(GL_VERTEX_SHADER, EmbeddedShaders::shader_vs);
+	stages.stage(GL_FRAGMENT_SHADER, EmbeddedShaders::shader_fs);
+	stages.stage(GL_FRAGMENT_SHADER, EmbeddedShaders::virtual_fs);
+	double again = millisecondsSince(start);
+
+	bool linked = cubeProgram.ID != 0 && virtualProgram.ID != 0 && vertexStage.ID != 0;
+	bool valid = linked && validate(cubePipeline) && validate(virtualPipeline);
+	bool reused = &sharedAgain == &vertexStage && stages.linkCount == pipelineLinks;
+
+	std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+	std::cout << std::fixed << std::setprecision(1)
+		<< "programs  " << std::setw(8) << programs << " ms  4 shaders compiled, 2 links" << std::endl
+		<< "pipelines " << std::setw(8) << pipelines << " ms  3 shaders compiled, " << pipelineLinks << " links"
+		<< (valid ? ", both valid" : ", NOT VALID") << std::endl
+		<< "again     " << std::setw(8) << std::setprecision(3) << again << " ms  "
+		<< (reused ? "no new links" : "LINKED AGAIN") << std::endl;
+
+	glDeleteProgramPipelines(1, &cubePipeline.ID);
+	glDeleteProgramPipelines(1, &virtualPipeline.ID);
+	glDeleteProgram(cubeProgram.ID);
+	glDeleteProgram(virtualProgram.ID);
+	stages.clear();
+	std::filesystem::remove_all(cache, error);
+	glfwTerminate();
+	return valid && reused ? 0 : 1;
+}
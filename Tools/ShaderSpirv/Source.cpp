@@ -0,0 +1,171 @@
+/*
+	ShaderSpirv: validates GLSL shaders and compiles them to SPIR-V for OpenGL.
+
+	Usage: ShaderSpirv <output dir> [-DNAME=VALUE ...] <shader files...>
+
+	Each .vs/.fs file is run through the lesson's ShaderPreprocessor (so #include
+	and defines work the same as at runtime) and then compiled by glslangValidator
+	(from glslang, it must be in the PATH) targeting OpenGL SPIR-V. Any GLSL error
+	makes the tool fail, so it's caught while building instead of as an
+	ERROR::SHADER print when the lesson runs.
+
+	For every file it writes <name>.spv and <name>.uniforms, the "location name"
+	list of layout(location = N) uniforms, since SPIR-V keeps no uniform names.
+	For the same reason the stage inputs and outputs (TexCoord, FragColor...)
+	must have a layout(location = N) too, glslang rejects them otherwise.
+*/
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <cstdlib>
+#include <cctype>
+
+#include "../../7_Camera/OpenGL/shader_preprocessor.h"
+
+// glslang stage name from the extensions used in the lessons
+std::string stageOf(const std::filesystem::path& path) {
+	std::string extension = path.extension().string();
+	if (extension == ".vs" || extension == ".vert")
+		return "vert";
+	if (extension == ".fs" || extension == ".frag")
+		return "frag";
+	return "";
+}
+
+std::string withoutComments(const std::string& source) {
+	std::string result;
+	for (size_t i = 0; i < source.size(); i++) {
+		if (source.compare(i, 2, "//") == 0) {
+			while (i < source.size() && source[i] != '\n')
+				i++;
+		}
+		else if (source.compare(i, 2, "/*") == 0) {
+			size_t end = source.find("*/", i + 2);
+			i = end == std::string::npos ? source.size() : end + 1;
+			continue;
+		}
+		if (i < source.size())
+			result += source[i];
+	}
+	return result;
+}
+
+/*
+	Finds declarations like "layout (location = 1) uniform float mixAmount;".
+	It's not a GLSL parser, it only looks at each statement on its own,
+	which is enough for how the lessons declare their uniforms.
+*/
+std::vector<std::pair<int, std::string>> explicitUniforms(const std::string& source) {
+	std::vector<std::pair<int, std::string>> uniforms;
+
+	// Preprocessor lines aren't statements
+	std::string code;
+	std::istringstream lines(withoutComments(source));
+	std::string line;
+	while (std::getline(lines, line)) {
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line[start] != '#')
+			code += line + "\n";
+	}
+
+	size_t begin = 0;
+	while (begin < code.size()) {
+		size_t end = code.find(';', begin);
+		if (end == std::string::npos)
+			break;
+		std::string statement = code.substr(begin, end - begin);
+		begin = end + 1;
+
+		size_t layout = statement.find("layout");
+		size_t uniform = statement.find("uniform");
+		if (layout == std::string::npos || uniform == std::string::npos || statement.find('{') != std::string::npos)
+			continue;
+
+		size_t location = statement.find("location", layout);
+		if (location == std::string::npos || location > uniform)
+			continue;
+		size_t equals = statement.find('=', location);
+		if (equals == std::string::npos)
+			continue;
+		int value = std::atoi(statement.c_str() + equals + 1);
+
+		// The name is the last identifier, without any array size
+		std::string declaration = statement.substr(0, statement.find('['));
+		size_t nameEnd = declaration.find_last_not_of(" \t\r\n");
+		if (nameEnd == std::string::npos)
+			continue;
+		size_t nameStart = nameEnd;
+		while (nameStart > 0 && (std::isalnum((unsigned char)declaration[nameStart - 1]) || declaration[nameStart - 1] == '_'))
+			nameStart--;
+		uniforms.push_back({ value, declaration.substr(nameStart, nameEnd - nameStart + 1) });
+	}
+	return uniforms;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cout << "Usage: ShaderSpirv <output dir> [-DNAME=VALUE ...] <shader files...>" << std::endl;
+		return 1;
+	}
+
+	std::filesystem::path outputDirectory = argv[1];
+	std::error_code error;
+	std::filesystem::create_directories(outputDirectory, error);
+
+	ShaderDefines defines;
+	std::vector<std::filesystem::path> files;
+	for (int i = 2; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument.compare(0, 2, "-D") == 0) {
+			size_t equals = argument.find('=');
+			if (equals == std::string::npos)
+				defines[argument.substr(2)] = "";
+			else
+				defines[argument.substr(2, equals - 2)] = argument.substr(equals + 1);
+		}
+		else {
+			files.push_back(argument);
+		}
+	}
+
+	int failed = 0;
+	for (const std::filesystem::path& file : files) {
+		std::string stage = stageOf(file);
+		if (stage.empty()) {
+			std::cout << "ERROR::SHADER_SPIRV::UNKNOWN_STAGE\n" << file.string() << std::endl;
+			failed++;
+			continue;
+		}
+
+		std::string source = ShaderPreprocessor::process(file, defines);
+		if (source.empty()) {
+			failed++;
+			continue;
+		}
+
+		// glslangValidator reads files, so the preprocessed source goes to a temporary one
+		std::filesystem::path name = file.filename();
+		std::filesystem::path expanded = outputDirectory / (name.string() + ".glsl");
+		std::filesystem::path spirv = outputDirectory / (name.string() + ".spv");
+		std::ofstream(expanded, std::ios::binary) << source;
+
+		// -G: SPIR-V for OpenGL (not Vulkan), -S: stage, since the extension isn't .vert/.frag
+		std::string command = "glslangValidator -G -S " + stage + " -o \"" + spirv.string() + "\" \"" + expanded.string() + "\"";
+		if (std::system(command.c_str()) != 0) {
+			std::cout << "ERROR::SHADER_SPIRV::COMPILATION_FAILED\n" << file.string() << std::endl;
+			failed++;
+			continue;
+		}
+		std::filesystem::remove(expanded, error);
+
+		std::ofstream uniforms(outputDirectory / (name.string() + ".uniforms"));
+		for (const auto& uniform : explicitUniforms(source))
+			uniforms << uniform.first << " " << uniform.second << "\n";
+	}
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,391 @@
+/*
+	TextureBenchmark: times every stage of the lesson's texture path, so
+	changes to TextureLoader can be judged by numbers.
+
+	Usage: TextureBenchmark [--iterations N] [--sizes 256,512,...] [--json output.json]
+		[--osmesa] [--cpu-only] [image files...]
+
+	Each case is an image file, decoded and uploaded --iterations times
+	(10 by default). Synthetic images are written first for every size in
+	--sizes (256, 512, 1024 and 2048 by default) with 1, 3 and 4 channels,
+	as uncompressed .tga so decoding costs the same whatever the content.
+	Image files given on the command line (jpg, png...) are added as they are.
+
+	The stages, in the order the loader runs them:
+		stbi_load          decode, with the same ImageArena hooks as image.cpp
+		expand_rgba        3 channel images widened to RGBA (TextureLoader::expandToRgba)
+		mip_generator      the whole mip chain on the CPU (MipGenerator, Kaiser)
+		glTexImage2D       level 0 into a mutable texture
+		glTexSubImage2D    level 0 into immutable storage, what the loader does now
+		glGenerateMipmap   the mip chain on the GL side, instead of mip_generator
+	RGB and RGBA cases are also uploaded as sRGB (GL_SRGB8_ALPHA8), the
+	format the internal format column shows.
+
+	GL stages end with glFinish, so they measure the work and not only the
+	call. For each stage it prints the 50th, 90th and 99th percentile and
+	the worst time in milliseconds, and MB/s (bytes the stage writes over
+	its median time). --json writes the same numbers for regression tracking.
+
+	The window is hidden, so it runs without a GPU on Mesa's llvmpipe
+	(e.g. with Xvfb), or with --osmesa on GLFW's OSMesa backend with no
+	display at all. --cpu-only skips the GL stages and doesn't create a context.
+*/
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "../../7_Camera/OpenGL/texture_loader.h"
+#include "../../7_Camera/OpenGL/mip_generator.h"
+#include "../../7_Camera/OpenGL/thread_pool.h"
+#include "../../7_Camera/OpenGL/image_arena.h"
+
+// Same hooks as the lesson's image.cpp
+#define STBI_MALLOC(size) ImageArena::allocate(size)
+#define STBI_REALLOC(pointer, size) ImageArena::reallocate(pointer, size)
+#define STBI_FREE(pointer) ImageArena::release(pointer)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+const char* stageNames[] = { "stbi_load", "expand_rgba", "mip_generator", "glTexImage2D", "glTexSubImage2D", "glGenerateMipmap" };
+enum Stage { STAGE_LOAD, STAGE_EXPAND, STAGE_MIPS_CPU, STAGE_TEX_IMAGE, STAGE_TEX_SUB_IMAGE, STAGE_MIPS_GL, STAGE_COUNT };
+
+struct Timings {
+	std::vector<double> milliseconds;
+	// Written by one run of the stage
+	uint64_t bytes = 0;
+
+	// Nearest rank
+	double percentile(double p) const {
+		std::vector<double> sorted = milliseconds;
+		std::sort(sorted.begin(), sorted.end());
+		size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+		return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+	}
+
+	double megabytesPerSecond() const {
+		double median = percentile(50.0);
+		return median > 0.0 ? bytes / (1024.0 * 1024.0) / (median / 1000.0) : 0.0;
+	}
+};
+
+struct Case {
+	std::string name;
+	std::filesystem::path path;
+	int width = 0, height = 0, channels = 0;
+	GLenum internalFormat = 0;
+	bool srgb = false;
+	Timings stages[STAGE_COUNT];
+};
+
+const char* formatName(GLenum format) {
+	switch (format) {
+	case GL_R8: return "GL_R8";
+	case GL_RG8: return "GL_RG8";
+	case GL_RGBA8: return "GL_RGBA8";
+	case GL_SRGB8_ALPHA8: return "GL_SRGB8_ALPHA8";
+	default: return "none";
+	}
+}
+
+// Uncompressed TGA (grayscale or BGR(A)), with a gradient and some noise
+bool writeTga(const std::filesystem::path& path, int size, int channels) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	uint8_t header[18] = {};
+	header[2] = channels == 1 ? 3 : 2;
+	header[12] = size & 0xFF;
+	header[13] = size >> 8;
+	header[14] = size & 0xFF;
+	header[15] = size >> 8;
+	header[16] = (uint8_t)(channels * 8);
+	header[17] = channels == 4 ? 8 : 0;
+	file.write((const char*)header, sizeof(header));
+
+	std::vector<uint8_t> row((size_t)size * channels);
+	uint32_t noise = 12345;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			for (int c = 0; c < channels; c++) {
+				noise = noise * 1664525u + 1013904223u;
+				row[(size_t)x * channels + c] = (uint8_t)((x * 255 / size + y * (c + 1) * 64 / size + (noise >> 28)) & 0xFF);
+			}
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+	return (bool)file;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned int newTexture() {
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	return texture;
+}
+
+void run(Case& test, int iterations, bool gl, ThreadPool& pool) {
+	stbi_set_flip_vertically_on_load(true);
+	// One more than asked, the first one pays for warming up the caches, the pool and the driver
+	for (int iteration = 0; iteration <= iterations; iteration++) {
+		ImageArena::Scope arena;
+
+		auto start = std::chrono::steady_clock::now();
+		int width, height, fileChannels;
+		unsigned char* data = stbi_load(test.path.string().c_str(), &width, &height, &fileChannels, 0);
+		double loadTime = millisecondsSince(start);
+		if (data == NULL) {
+			std::cout << "ERROR::TEXTURE_BENCHMARK::IMAGE_NOT_LOADED\n" << test.path.string() << std::endl;
+			return;
+		}
+		int channels = fileChannels == 3 ? 4 : fileChannels;
+		size_t pixels = (size_t)width * height;
+		test.width = width;
+		test.height = height;
+		test.channels = fileChannels;
+		test.internalFormat = TextureLoader::sizedFormat(channels, test.srgb);
+		test.stages[STAGE_LOAD].milliseconds.push_back(loadTime);
+		test.stages[STAGE_LOAD].bytes = pixels * fileChannels;
+
+		std::vector<unsigned char> expanded;
+		const unsigned char* level0 = data;
+		if (fileChannels == 3) {
+			expanded.resize(pixels * 4);
+			start = std::chrono::steady_clock::now();
+			TextureLoader::expandToRgba(data, expanded.data(), pixels);
+			test.stages[STAGE_EXPAND].milliseconds.push_back(millisecondsSince(start));
+			test.stages[STAGE_EXPAND].bytes = expanded.size();
+			level0 = expanded.data();
+		}
+
+		std::vector<unsigned char> chain(MipGenerator::chainSize(width, height, channels));
+		MipGenerator::Options options;
+		options.srgb = test.srgb;
+		start = std::chrono::steady_clock::now();
+		MipGenerator::generate(data, width, height, fileChannels, chain.data(), channels, options, &pool);
+		test.stages[STAGE_MIPS_CPU].milliseconds.push_back(millisecondsSince(start));
+		test.stages[STAGE_MIPS_CPU].bytes = chain.size();
+
+		if (gl) {
+			GLenum format = channels == 4 ? GL_RGBA : channels == 2 ? GL_RG : GL_RED;
+			glPixelStorei(GL_UNPACK_ALIGNMENT, channels == 4 ? 4 : 1);
+			int levels = MipGenerator::levelCount(width, height);
+			size_t levelBytes = pixels * channels;
+
+			unsigned int mutableTexture = newTexture();
+			glFinish();
+			start = std::chrono::steady_clock::now();
+			glTexImage2D(GL_TEXTURE_2D, 0, test.internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, level0);
+			glFinish();
+			test.stages[STAGE_TEX_IMAGE].milliseconds.push_back(millisecondsSince(start));
+			test.stages[STAGE_TEX_IMAGE].bytes = levelBytes;
+
+			// Storage allocated beforehand, like TextureLoader::upload
+			unsigned int texture = newTexture();
+			glTexStorage2D(GL_TEXTURE_2D, levels, test.internalFormat, width, height);
+			glFinish();
+			start = std::chrono::steady_clock::now();
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, level0);
+			glFinish();
+			test.stages[STAGE_TEX_SUB_IMAGE].milliseconds.push_back(millisecondsSince(start));
+			test.stages[STAGE_TEX_SUB_IMAGE].bytes = levelBytes;
+
+			start = std::chrono::steady_clock::now();
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glFinish();
+			test.stages[STAGE_MIPS_GL].milliseconds.push_back(millisecondsSince(start));
+			test.stages[STAGE_MIPS_GL].bytes = chain.size();
+
+			glDeleteTextures(1, &mutableTexture);
+			glDeleteTextures(1, &texture);
+		}
+		stbi_image_free(data);
+	}
+	for (Timings& timings : test.stages) {
+		if (!timings.milliseconds.empty())
+			timings.milliseconds.erase(timings.milliseconds.begin());
+	}
+}
+
+void print(const Case& test) {
+	std::cout << test.name << " (" << test.width << "x" << test.height << ", " << test.channels << " channels, "
+		<< formatName(test.internalFormat) << ")" << std::endl;
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		const Timings& timings = test.stages[stage];
+		if (timings.milliseconds.empty())
+			continue;
+		std::cout << "  " << std::left << std::setw(18) << stageNames[stage] << std::right << std::fixed << std::setprecision(3)
+			<< " p50 " << std::setw(9) << timings.percentile(50.0)
+			<< " p90 " << std::setw(9) << timings.percentile(90.0)
+			<< " p99 " << std::setw(9) << timings.percentile(99.0)
+			<< " max " << std::setw(9) << timings.percentile(100.0) << " ms "
+			<< std::setprecision(1) << std::setw(9) << timings.megabytesPerSecond() << " MB/s" << std::endl;
+	}
+}
+
+std::string jsonString(const std::string& text) {
+	std::string result = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			result += '\\';
+		result += c;
+	}
+	return result + "\"";
+}
+
+bool writeJson(const std::string& path, const std::vector<Case>& cases, int iterations, const std::string& renderer) {
+	std::ofstream file(path);
+	if (!file)
+		return false;
+	file << std::fixed << std::setprecision(4);
+	file << "{\n\t\"renderer\": " << jsonString(renderer) << ",\n\t\"iterations\": " << iterations << ",\n\t\"cases\": [";
+	for (size_t i = 0; i < cases.size(); i++) {
+		const Case& test = cases[i];
+		file << (i > 0 ? "," : "") << "\n\t\t{\n\t\t\t\"name\": " << jsonString(test.name)
+			<< ",\n\t\t\t\"width\": " << test.width << ",\n\t\t\t\"height\": " << test.height
+			<< ",\n\t\t\t\"channels\": " << test.channels << ",\n\t\t\t\"internalFormat\": " << jsonString(formatName(test.internalFormat))
+			<< ",\n\t\t\t\"stages\": {";
+		bool first = true;
+		for (int stage = 0; stage < STAGE_COUNT; stage++) {
+			const Timings& timings = test.stages[stage];
+			if (timings.milliseconds.empty())
+				continue;
+			file << (first ? "" : ",") << "\n\t\t\t\t" << jsonString(stageNames[stage]) << ": { "
+				<< "\"p50_ms\": " << timings.percentile(50.0) << ", \"p90_ms\": " << timings.percentile(90.0)
+				<< ", \"p99_ms\": " << timings.percentile(99.0) << ", \"max_ms\": " << timings.percentile(100.0)
+				<< ", \"bytes\": " << timings.bytes << ", \"mb_per_s\": " << timings.megabytesPerSecond() << " }";
+			first = false;
+		}
+		file << "\n\t\t\t}\n\t\t}";
+	}
+	file << "\n\t]\n}\n";
+	return (bool)file;
+}
+
+int main(int argc, char** argv) {
+	int iterations = 10;
+	std::vector<int> sizes = { 256, 512, 1024, 2048 };
+	std::string jsonPath;
+	bool osmesa = false, gl = true;
+	std::vector<std::filesystem::path> files;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--iterations" && i + 1 < argc)
+			iterations = std::max(1, std::stoi(argv[++i]));
+		else if (argument == "--json" && i + 1 < argc)
+			jsonPath = argv[++i];
+		else if (argument == "--osmesa")
+			osmesa = true;
+		else if (argument == "--cpu-only")
+			gl = false;
+		else if (argument == "--sizes" && i + 1 < argc) {
+			sizes.clear();
+			std::stringstream list(argv[++i]);
+			std::string size;
+			while (std::getline(list, size, ','))
+				sizes.push_back(std::stoi(size));
+		}
+		else
+			files.push_back(argument);
+	}
+
+	GLFWwindow* window = NULL;
+	std::string renderer = "none";
+	if (gl) {
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		if (osmesa)
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		window = glfwCreateWindow(64, 64, "TextureBenchmark", NULL, NULL);
+		if (window == NULL) {
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
+		renderer = (const char*)glGetString(GL_RENDERER);
+	}
+
+	// Synthetic images, written once next to the other temporary files
+	std::vector<Case> cases;
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "texture_benchmark";
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	for (int size : sizes) {
+		for (int channels : { 1, 3, 4 }) {
+			Case test;
+			test.name = std::to_string(size) + "_" + std::to_string(channels) + "ch.tga";
+			test.path = directory / test.name;
+			if (!std::filesystem::exists(test.path) && !writeTga(test.path, size, channels)) {
+				std::cout << "ERROR::TEXTURE_BENCHMARK::FILE_NOT_SUCCESFULLY_WRITTEN\n" << test.path.string() << std::endl;
+				return 1;
+			}
+			cases.push_back(test);
+		}
+	}
+	for (const std::filesystem::path& file : files) {
+		Case test;
+		test.name = file.filename().string();
+		test.path = file;
+		cases.push_back(test);
+	}
+	// Color images are also uploaded as sRGB, filtered in linear light
+	size_t count = cases.size();
+	for (size_t i = 0; i < count; i++) {
+		int channels = 0;
+		if (stbi_info(cases[i].path.string().c_str(), NULL, NULL, &channels) && channels >= 3) {
+			Case test = cases[i];
+			test.name += " srgb";
+			test.srgb = true;
+			cases.push_back(test);
+		}
+	}
+
+	ThreadPool pool;
+	std::cout << "Renderer: " << renderer << ", " << iterations << " iterations, " << pool.size() << " threads" << std::endl;
+	for (Case& test : cases) {
+		run(test, iterations, gl, pool);
+		print(test);
+	}
+	if (gl) {
+		GLenum glError = glGetError();
+		if (glError != GL_NO_ERROR)
+			std::cout << "ERROR::TEXTURE_BENCHMARK::GL_ERROR\n" << glError << std::endl;
+	}
+
+	if (!jsonPath.empty()) {
+		if (writeJson(jsonPath, cases, iterations, renderer))
+			std::cout << "Results written to " << jsonPath << std::endl;
+		else
+			std::cout << "ERROR::TEXTURE_BENCHMARK::FILE_NOT_SUCCESFULLY_WRITTEN\n" << jsonPath << std::endl;
+	}
+
+	if (window != NULL)
+		glfwTerminate();
+	return 0;
+}
@@ -0,0 +1,265 @@
+/*
+	TextureCooker: turns images into GPU-ready .ktx2 files.
+
+	Usage: TextureCooker <output dir> [--format rgba8|bc1|bc3|bc7] [--quality fast|normal|high]
+		[--mip-filter box|kaiser] [--srgb] [--no-flip] [--benchmark] [--virtual [--tile-size N]] <image files...>
+
+	Every image (anything stb_image reads) is decoded once here instead of
+	every time the lesson starts. It's expanded to RGBA, flipped so the first
+	row is the bottom one like stbi_set_flip_vertically_on_load(true) does,
+	and its whole mip chain is built and stored. At runtime Ktx2Texture maps
+	the file and uploads the levels as they are.
+
+	--format bc1/bc3/bc7 compresses every level with BlockCompression,
+	4-8x smaller than rgba8 (the default) in memory and on disk.
+	bc1 is for opaque images or 1 bit alpha, bc3 and bc7 keep full alpha.
+
+	--mip-filter picks the filter MipGenerator builds the levels with,
+	kaiser (the default) keeps small levels sharper than a 2x2 box.
+
+	--srgb marks the texture as sRGB (GL_SRGB8_ALPHA8), for color textures
+	drawn with GL_FRAMEBUFFER_SRGB. Mip levels are then filtered in linear
+	light.
+
+	--virtual writes a .vtex tile file for VirtualTexture instead: every
+	level cut into tiles of --tile-size texels (128 by default) with a
+	4 texel border, RGBA8. The image must be the tile size times a power
+	of two on each side.
+
+	--benchmark compresses the first level of each image with every quality
+	preset and prints the speed (megapixels per second) and the PSNR against
+	the original, for the SIMD encoder and the scalar one.
+*/
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "../../7_Camera/OpenGL/ktx2.h"
+#include "../../7_Camera/OpenGL/block_compressor.h"
+#include "../../7_Camera/OpenGL/mip_generator.h"
+#include "../../7_Camera/OpenGL/virtual_texture_file.h"
+
+const char* qualityNames[] = { "fast", "normal", "high" };
+
+uint32_t ktx2Format(const std::string& name, bool srgb) {
+	if (name == "bc1")
+		return srgb ? Ktx2::FORMAT_BC1_RGBA_SRGB : Ktx2::FORMAT_BC1_RGBA_UNORM;
+	if (name == "bc3")
+		return srgb ? Ktx2::FORMAT_BC3_SRGB : Ktx2::FORMAT_BC3_UNORM;
+	if (name == "bc7")
+		return srgb ? Ktx2::FORMAT_BC7_SRGB : Ktx2::FORMAT_BC7_UNORM;
+	if (name == "rgba8")
+		return srgb ? Ktx2::FORMAT_R8G8B8A8_SRGB : Ktx2::FORMAT_R8G8B8A8_UNORM;
+	return Ktx2::FORMAT_UNDEFINED;
+}
+
+BlockCompression::Format blockFormat(uint32_t format) {
+	if (format == Ktx2::FORMAT_BC1_RGBA_UNORM || format == Ktx2::FORMAT_BC1_RGBA_SRGB)
+		return BlockCompression::FORMAT_BC1;
+	if (format == Ktx2::FORMAT_BC3_UNORM || format == Ktx2::FORMAT_BC3_SRGB)
+		return BlockCompression::FORMAT_BC3;
+	return BlockCompression::FORMAT_BC7;
+}
+
+// Speed and quality of every preset on one image
+void benchmark(const std::string& name, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height,
+	BlockCompression::Format format, ThreadPool& pool) {
+	CpuFeatures::Simd detected = BlockCompression::simd;
+	CpuFeatures::Simd levels[2] = { detected, CpuFeatures::SIMD_SCALAR };
+
+	for (int simdLevel = 0; simdLevel < (detected == CpuFeatures::SIMD_SCALAR ? 1 : 2); simdLevel++) {
+		BlockCompression::simd = levels[simdLevel];
+		for (int quality = 0; quality < 3; quality++) {
+			// Best of 3 runs, the first one also pays for warming up the pool and caches
+			double bestSeconds = 1e30;
+			std::vector<uint8_t> blocks;
+			for (int run = 0; run < 3; run++) {
+				auto start = std::chrono::steady_clock::now();
+				blocks = BlockCompression::compress(rgba.data(), width, height, format, (BlockCompression::Quality)quality, &pool);
+				bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+			}
+			std::vector<uint8_t> decoded = BlockCompression::decompress(blocks.data(), width, height, format);
+
+			std::cout << std::fixed << std::setprecision(2) << name << " " << CpuFeatures::name(levels[simdLevel])
+				<< " " << qualityNames[quality] << ": " << width * (double)height / 1e6 / bestSeconds << " MP/s, PSNR "
+				<< BlockCompression::psnr(rgba.data(), decoded.data(), rgba.size()) << " dB ("
+				<< pool.size() << " threads)" << std::endl;
+		}
+	}
+	BlockCompression::simd = detected;
+}
+
+void printUsage() {
+	std::cout << "Usage: TextureCooker <output dir> [--format rgba8|bc1|bc3|bc7] [--quality fast|normal|high]\n"
+		"\t[--mip-filter box|kaiser] [--srgb] [--no-flip] [--benchmark] [--virtual [--tile-size N]] <image files...>" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		printUsage();
+		return 1;
+	}
+
+	std::filesystem::path outputDirectory = argv[1];
+	std::error_code error;
+	std::filesystem::create_directories(outputDirectory, error);
+
+	bool srgb = false;
+	bool flip = true;
+	bool runBenchmark = false;
+	std::string formatName = "rgba8";
+	BlockCompression::Quality quality = BlockCompression::QUALITY_NORMAL;
+	MipGenerator::Filter mipFilter = MipGenerator::FILTER_KAISER;
+	bool virtualTexture = false;
+	uint32_t tileSize = 128;
+	std::vector<std::filesystem::path> files;
+	for (int i = 2; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--srgb")
+			srgb = true;
+		else if (argument == "--no-flip")
+			flip = false;
+		else if (argument == "--benchmark")
+			runBenchmark = true;
+		else if (argument == "--virtual")
+			virtualTexture = true;
+		else if (argument == "--tile-size" || argument == "--format" || argument == "--mip-filter" || argument == "--quality") {
+			if (i + 1 >= argc) {
+				std::cout << "ERROR::TEXTURE_COOKER::MISSING_VALUE\n" << argument << std::endl;
+				printUsage();
+				return 1;
+			}
+			std::string value = argv[++i];
+			if (argument == "--tile-size") {
+				char* end = nullptr;
+				errno = 0;
+				unsigned long size = std::strtoul(value.c_str(), &end, 10);
+				if (value.empty() || *end != '\0' || errno == ERANGE || size == 0 || size > 4096) {
+					std::cout << "ERROR::TEXTURE_COOKER::BAD_TILE_SIZE\n" << value << " (1 to 4096 texels)" << std::endl;
+					return 1;
+				}
+				tileSize = (uint32_t)size;
+			}
+			else if (argument == "--format")
+				formatName = value;
+			else if (argument == "--mip-filter") {
+				if (value == "box")
+					mipFilter = MipGenerator::FILTER_BOX;
+				else if (value == "kaiser")
+					mipFilter = MipGenerator::FILTER_KAISER;
+				else {
+					std::cout << "ERROR::TEXTURE_COOKER::UNKNOWN_MIP_FILTER\n" << value << std::endl;
+					return 1;
+				}
+			}
+			else {
+				int found = -1;
+				for (int q = 0; q < 3; q++) {
+					if (value == qualityNames[q])
+						found = q;
+				}
+				if (found == -1) {
+					std::cout << "ERROR::TEXTURE_COOKER::UNKNOWN_QUALITY\n" << value << std::endl;
+					return 1;
+				}
+				quality = (BlockCompression::Quality)found;
+			}
+		}
+		else if (argument.compare(0, 2, "--") == 0) {
+			std::cout << "ERROR::TEXTURE_COOKER::UNKNOWN_OPTION\n" << argument << std::endl;
+			printUsage();
+			return 1;
+		}
+		else
+			files.push_back(argument);
+	}
+
+	uint32_t format = ktx2Format(formatName, srgb);
+	if (format == Ktx2::FORMAT_UNDEFINED) {
+		std::cout << "ERROR::TEXTURE_COOKER::UNKNOWN_FORMAT\n" << formatName << std::endl;
+		return 1;
+	}
+	// Other tools (libktx, ktx validate) trust the descriptor over vkFormat, it must read back as the format
+	if (Ktx2::describedFormat(Ktx2::formatDescriptor(format)) != format) {
+		std::cout << "ERROR::TEXTURE_COOKER::BAD_FORMAT_DESCRIPTOR\n" << formatName << std::endl;
+		return 1;
+	}
+
+	// Mip levels and blocks are built on every core
+	ThreadPool pool;
+
+	int failed = 0;
+	for (const std::filesystem::path& file : files) {
+		int width, height, nrChannels;
+		stbi_set_flip_vertically_on_load(flip);
+		// Always 4 channels, so every texture is RGBA8 whatever the source had
+		unsigned char* data = stbi_load(file.string().c_str(), &width, &height, &nrChannels, 4);
+		if (!data) {
+			std::cout << "ERROR::TEXTURE_COOKER::LOAD_FAILED\n" << file.string() << ": " << stbi_failure_reason() << std::endl;
+			failed++;
+			continue;
+		}
+
+		MipGenerator::Options mipOptions;
+		mipOptions.filter = mipFilter;
+		mipOptions.srgb = srgb;
+		std::vector<std::vector<uint8_t>> levels;
+		levels.emplace_back(data, data + (size_t)width * height * 4);
+		for (std::vector<uint8_t>& level : MipGenerator::generateLevels(data, width, height, 4, mipOptions, &pool))
+			levels.push_back(std::move(level));
+		stbi_image_free(data);
+
+		if (virtualTexture) {
+			std::filesystem::path output = outputDirectory / file.filename().replace_extension(".vtex");
+			if (VirtualTextureFile::levelCount(width, height, tileSize) == 0) {
+				std::cout << "ERROR::TEXTURE_COOKER::VIRTUAL_TEXTURE_SIZE\n" << file.string() << ": " << width << "x" << height
+					<< " isn't " << tileSize << " times a power of two" << std::endl;
+				failed++;
+			}
+			else if (!VirtualTextureFile::write(output.string(), width, height, tileSize, 4, levels)) {
+				std::cout << "ERROR::TEXTURE_COOKER::WRITE_FAILED\n" << output.string() << std::endl;
+				failed++;
+			}
+			else
+				std::cout << file.string() << " -> " << output.string() << " (" << width << "x" << height << ", "
+					<< VirtualTextureFile::levelCount(width, height, tileSize) << " levels of " << tileSize << " texel tiles)" << std::endl;
+			continue;
+		}
+
+		if (runBenchmark)
+			benchmark(file.filename().string(), levels[0], width, height,
+				Ktx2::isCompressed(format) ? blockFormat(format) : BlockCompression::FORMAT_BC7, pool);
+
+		if (Ktx2::isCompressed(format)) {
+			uint32_t levelWidth = width, levelHeight = height;
+			for (std::vector<uint8_t>& level : levels) {
+				level = BlockCompression::compress(level.data(), levelWidth, levelHeight, blockFormat(format), quality, &pool);
+				levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+				levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+			}
+		}
+
+		std::filesystem::path output = outputDirectory / file.filename().replace_extension(".ktx2");
+		if (!Ktx2::write(output.string(), format, width, height, levels, flip)) {
+			std::cout << "ERROR::TEXTURE_COOKER::WRITE_FAILED\n" << output.string() << std::endl;
+			failed++;
+			continue;
+		}
+		std::cout << file.string() << " -> " << output.string() << " (" << width << "x" << height << ", "
+			<< levels.size() << " levels, " << formatName << ")" << std::endl;
+	}
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+	UniformBenchmark: times setting a uniform the old way against the
+	setters of Shader.
+
+	Usage: UniformBenchmark [--calls N] [--osmesa]
+
+	Each way sets a mat4 "model" uniform --calls times (1000000 by default),
+	best of 5 runs, and prints nanoseconds per call:
+		glGetUniformLocation   what the setters did before: ask the driver
+		                       for the location by name on every call
+		setMat4("model")       the string setter: builds a std::string and
+		                       hashes it, then one probe in the uniform table
+		setMat4(UniformHandle) hash computed by the compiler, only the probe
+
+	The window is hidden, so it runs without a GPU on Mesa's llvmpipe
+	(e.g. with Xvfb), or with --osmesa on GLFW's OSMesa backend with no
+	display at all.
+*/
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "../../7_Camera/OpenGL/shader.h"
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+const char* vertexSource = R"GLSL(#version 330 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+void main() {
+	gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
+)GLSL";
+
+const char* fragmentSource = R"GLSL(#version 330 core
+out vec4 FragColor;
+uniform vec4 color;
+void main() {
+	FragColor = color;
+}
+)GLSL";
+
+unsigned int compile(GLenum type, const char* source) {
+	unsigned int shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	int success;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (success == GL_FALSE) {
+		char infoLog[1024];
+		glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+		std::cout << "ERROR::UNIFORM_BENCHMARK::COMPILATION_FAILED\n" << infoLog << std::endl;
+	}
+	return shader;
+}
+
+// Best of 5 runs, in nanoseconds per call
+double time(unsigned int calls, const std::function<void(unsigned int)>& body) {
+	double best = 1e30;
+	for (int run = 0; run < 5; run++) {
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < calls; i++)
+			body(i);
+		glFinish();
+		best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls);
+	}
+	return best;
+}
+
+int main(int argc, char** argv) {
+	unsigned int calls = 1000000;
+	bool osmesa = false;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--calls" && i + 1 < argc)
+			calls = std::max(1u, (unsigned int)std::stoul(argv[++i]));
+		else if (argument == "--osmesa")
+			osmesa = true;
+		else {
+			std::cout << "Usage: UniformBenchmark [--calls N] [--osmesa]" << std::endl;
+			return 1;
+		}
+	}
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	if (osmesa)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "UniformBenchmark", NULL, NULL);
+	if (window == NULL) {
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	unsigned int program = glCreateProgram();
+	unsigned int vertexShader = compile(GL_VERTEX_SHADER, vertexSource);
+	unsigned int fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentSource);
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	int linked;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE) {
+		std::cout << "ERROR::UNIFORM_BENCHMARK::LINK_FAILED" << std::endl;
+		return -1;
+	}
+
+	// Builds the uniform table like any other program of the lesson
+	Shader shader(program);
+	shader.use();
+
+	// A different matrix every call, so the driver can't skip any
+	glm::mat4 matrix(1.0f);
+	auto next = [&matrix](unsigned int i) -> const glm::mat4& {
+		matrix[3][0] = (float)(i & 1023);
+		return matrix;
+	};
+	constexpr UniformHandle modelUniform("model");
+
+	double byLocation = time(calls, [&](unsigned int i) {
+		glUniformMatrix4fv(glGetUniformLocation(shader.ID, "model"), 1, GL_FALSE, glm::value_ptr(next(i)));
+	});
+	double byString = time(calls, [&](unsigned int i) {
+		shader.setMat4("model", GL_FALSE, next(i));
+	});
+	double byHandle = time(calls, [&](unsigned int i) {
+		shader.setMat4(modelUniform, GL_FALSE, next(i));
+	});
+
+	std::cout << "Renderer: " << glGetString(GL_RENDERER) << ", " << calls << " calls each" << std::endl;
+	std::cout << std::fixed << std::setprecision(1)
+		<< std::left << std::setw(24) << "glGetUniformLocation" << std::right << std::setw(8) << byLocation << " ns/call" << std::endl
+		<< std::left << std::setw(24) << "setMat4(\"model\")" << std::right << std::setw(8) << byString << " ns/call"
+		<< std::setprecision(2) << "  " << byLocation / byString << "x" << std::endl << std::setprecision(1)
+		<< std::left << std::setw(24) << "setMat4(UniformHandle)" << std::right << std::setw(8) << byHandle << " ns/call"
+		<< std::setprecision(2) << "  " << byLocation / byHandle << "x" << std::endl;
+
+	glDeleteProgram(program);
+	glfwTerminate();
+	return 0;
+}